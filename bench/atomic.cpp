@@ -0,0 +1,123 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+
+#include "core/atomic.hpp"
+#include "core/time.hpp"
+
+// time contended write_min on SSSP-style labels of 4, 8 and 16 bytes (a distance alone, and a distance with
+// its parent updated in one CAS), and check the final labels against a serial reduction of the same updates
+
+struct Label4 {
+  float distance;
+  bool operator<(const Label4 & other) const {
+    return distance < other.distance;
+  }
+};
+
+struct Label8 {
+  float distance;
+  uint32_t parent;
+  bool operator<(const Label8 & other) const {
+    return distance < other.distance || (distance == other.distance && parent < other.parent);
+  }
+};
+
+struct alignas(16) Label16 {
+  double distance;
+  uint64_t parent;
+  bool operator<(const Label16 & other) const {
+    return distance < other.distance || (distance == other.distance && parent < other.parent);
+  }
+};
+
+template <class L>
+L make_label(uint64_t key);
+
+template <>
+Label4 make_label<Label4>(uint64_t key) {
+  return Label4{(float)(key % 1000)};
+}
+
+template <>
+Label8 make_label<Label8>(uint64_t key) {
+  return Label8{(float)(key % 1000), (uint32_t)(key >> 32)};
+}
+
+template <>
+Label16 make_label<Label16>(uint64_t key) {
+  return Label16{(double)(key % 1000), key >> 32};
+}
+
+inline uint64_t update_key(uint64_t u_i) {
+  uint64_t key = (u_i + 1) * 0x9E3779B97F4A7C15ull;
+  return key ^ (key >> 29);
+}
+
+template <class L>
+void run(size_t slots, size_t updates) {
+  L * labels = new L [slots];
+  L * expected = new L [slots];
+  for (size_t s_i=0;s_i<slots;s_i++) {
+    labels[s_i] = make_label<L>(~0ull);
+    expected[s_i] = labels[s_i];
+  }
+  for (size_t u_i=0;u_i<updates;u_i++) {
+    uint64_t key = update_key(u_i);
+    L label = make_label<L>(key);
+    if (label < expected[key % slots]) {
+      expected[key % slots] = label;
+    }
+  }
+
+  double exec_time = 0;
+  exec_time -= get_time();
+  #pragma omp parallel for
+  for (size_t u_i=0;u_i<updates;u_i++) {
+    uint64_t key = update_key(u_i);
+    write_min_relaxed(&labels[key % slots], make_label<L>(key));
+  }
+  exec_time += get_time();
+
+  size_t mismatches = 0;
+  for (size_t s_i=0;s_i<slots;s_i++) {
+    if (labels[s_i] < expected[s_i] || expected[s_i] < labels[s_i]) {
+      mismatches += 1;
+    }
+  }
+  printf("bytes=%lu slots=%lu threads=%d time=%lf(s) per_update=%lf(ns) mismatches=%lu\n", sizeof(L), slots, omp_get_max_threads(), exec_time, exec_time * 1e9 / updates, mismatches);
+  delete [] labels;
+  delete [] expected;
+}
+
+int main(int argc, char ** argv) {
+  if (argc<3) {
+    printf("atomic [slots] [updates]\n");
+    exit(-1);
+  }
+  size_t slots = std::atol(argv[1]);
+  size_t updates = std::atol(argv[2]);
+
+  run<Label4>(slots, updates);
+  run<Label8>(slots, updates);
+  #ifdef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16
+  run<Label16>(slots, updates);
+  #endif
+  return 0;
+}
@@ -0,0 +1,215 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "core/graph.hpp"
+
+// compare the per-edge cost of process_edges / process_vertices with inlined lambdas (template overloads)
+// against the same lambdas behind std::function (compatibility overloads), on PageRank and BFS
+
+// Wrap = std::function<...> selects the type-erased overloads, Wrap = the lambda type itself the inlined ones
+template <typename Wrap, typename F>
+Wrap as(F f) {
+  return Wrap(f);
+}
+
+template <bool erased>
+double pagerank(Graph<Empty> * graph, int iterations, double & checksum) {
+  const double d = (double)0.85;
+  double * curr = graph->alloc_vertex_array<double>();
+  double * next = graph->alloc_vertex_array<double>();
+  VertexSubset * active = graph->alloc_vertex_subset();
+  active->fill();
+  graph->fill_vertex_array(curr, (double)1 / graph->vertices);
+
+  auto sparse_signal = [&](VertexId src){
+    graph->emit(src, curr[src]);
+  };
+  auto sparse_slot = [&](VertexId src, double msg, VertexAdjList<Empty> outgoing_adj){
+    for (AdjUnit<Empty> * ptr=outgoing_adj.begin;ptr!=outgoing_adj.end;ptr++) {
+      VertexId dst = ptr->neighbour;
+      write_add(&next[dst], msg);
+    }
+    return 0;
+  };
+  auto dense_signal = [&](VertexId dst, VertexAdjList<Empty> incoming_adj) {
+    double sum = 0;
+    for (AdjUnit<Empty> * ptr=incoming_adj.begin;ptr!=incoming_adj.end;ptr++) {
+      VertexId src = ptr->neighbour;
+      sum += curr[src];
+    }
+    graph->emit(dst, sum);
+  };
+  auto dense_slot = [&](VertexId dst, double msg) {
+    write_add(&next[dst], msg);
+    return 0;
+  };
+  auto scale = [&](VertexId vtx) {
+    if (graph->out_degree[vtx]>0) {
+      curr[vtx] /= graph->out_degree[vtx];
+    }
+    return 0;
+  };
+  auto update = [&](VertexId vtx) {
+    next[vtx] = 1 - d + d * next[vtx];
+    return 0;
+  };
+  typedef typename std::conditional<erased, std::function<void(VertexId)>, decltype(sparse_signal)>::type SparseSignal;
+  typedef typename std::conditional<erased, std::function<int(VertexId, double, VertexAdjList<Empty>)>, decltype(sparse_slot)>::type SparseSlot;
+  typedef typename std::conditional<erased, std::function<void(VertexId, VertexAdjList<Empty>)>, decltype(dense_signal)>::type DenseSignal;
+  typedef typename std::conditional<erased, std::function<int(VertexId, double)>, decltype(dense_slot)>::type DenseSlot;
+  typedef typename std::conditional<erased, std::function<int(VertexId)>, decltype(scale)>::type Scale;
+  typedef typename std::conditional<erased, std::function<int(VertexId)>, decltype(update)>::type Update;
+
+  double exec_time = 0;
+  exec_time -= get_time();
+  for (int i_i=0;i_i<iterations;i_i++) {
+    graph->fill_vertex_array(next, (double)0);
+    graph->process_vertices<int>(as<Scale>(scale), active);
+    graph->process_edges<int,double>(as<SparseSignal>(sparse_signal), as<SparseSlot>(sparse_slot), as<DenseSignal>(dense_signal), as<DenseSlot>(dense_slot), active);
+    graph->process_vertices<int>(as<Update>(update), active);
+    std::swap(curr, next);
+  }
+  exec_time += get_time();
+  checksum = graph->process_vertices<double>(
+    [&](VertexId vtx) {
+      return curr[vtx];
+    },
+    active
+  );
+
+  graph->dealloc_vertex_array(curr);
+  graph->dealloc_vertex_array(next);
+  delete active;
+  return exec_time;
+}
+
+template <bool erased>
+double bfs(Graph<Empty> * graph, VertexId root, double & checksum) {
+  VertexId * parent = graph->alloc_vertex_array<VertexId>();
+  VertexSubset * visited = graph->alloc_vertex_subset();
+  VertexSubset * active_in = graph->alloc_vertex_subset();
+  VertexSubset * active_out = graph->alloc_vertex_subset();
+  visited->clear();
+  visited->set_bit(root);
+  active_in->clear();
+  active_in->set_bit(root);
+  active_out->clear();
+  graph->fill_vertex_array(parent, graph->vertices);
+  parent[root] = root;
+
+  auto sparse_signal = [&](VertexId src){
+    graph->emit(src, src);
+  };
+  auto sparse_slot = [&](VertexId src, VertexId msg, VertexAdjList<Empty> outgoing_adj){
+    VertexId activated = 0;
+    for (AdjUnit<Empty> * ptr=outgoing_adj.begin;ptr!=outgoing_adj.end;ptr++) {
+      VertexId dst = ptr->neighbour;
+      if (ttas(&parent[dst], graph->vertices, src)) {
+        active_out->set_bit(dst);
+        activated += 1;
+      }
+    }
+    return activated;
+  };
+  auto dense_signal = [&](VertexId dst, VertexAdjList<Empty> incoming_adj) {
+    if (visited->get_bit(dst)) return;
+    for (AdjUnit<Empty> * ptr=incoming_adj.begin;ptr!=incoming_adj.end;ptr++) {
+      VertexId src = ptr->neighbour;
+      if (active_in->get_bit(src)) {
+        graph->emit(dst, src);
+        break;
+      }
+    }
+  };
+  auto dense_slot = [&](VertexId dst, VertexId msg) {
+    if (ttas(&parent[dst], graph->vertices, msg)) {
+      active_out->set_bit(dst);
+      return (VertexId)1;
+    }
+    return (VertexId)0;
+  };
+  auto mark = [&](VertexId vtx) {
+    visited->set_bit(vtx);
+    return (VertexId)1;
+  };
+  typedef typename std::conditional<erased, std::function<void(VertexId)>, decltype(sparse_signal)>::type SparseSignal;
+  typedef typename std::conditional<erased, std::function<VertexId(VertexId, VertexId, VertexAdjList<Empty>)>, decltype(sparse_slot)>::type SparseSlot;
+  typedef typename std::conditional<erased, std::function<void(VertexId, VertexAdjList<Empty>)>, decltype(dense_signal)>::type DenseSignal;
+  typedef typename std::conditional<erased, std::function<VertexId(VertexId, VertexId)>, decltype(dense_slot)>::type DenseSlot;
+  typedef typename std::conditional<erased, std::function<VertexId(VertexId)>, decltype(mark)>::type Mark;
+
+  double exec_time = 0;
+  exec_time -= get_time();
+  VertexId active_vertices = 1;
+  while (active_vertices>0) {
+    active_out->clear();
+    graph->process_edges<VertexId,VertexId>(as<SparseSignal>(sparse_signal), as<SparseSlot>(sparse_slot), as<DenseSignal>(dense_signal), as<DenseSlot>(dense_slot), active_in, visited);
+    active_vertices = graph->process_vertices<VertexId>(as<Mark>(mark), active_out);
+    std::swap(active_in, active_out);
+  }
+  exec_time += get_time();
+  checksum = graph->process_vertices<VertexId>(
+    [&](VertexId vtx) {
+      return (VertexId)(parent[vtx] < graph->vertices);
+    },
+    visited
+  );
+
+  graph->dealloc_vertex_array(parent);
+  delete visited;
+  delete active_in;
+  delete active_out;
+  return exec_time;
+}
+
+int main(int argc, char ** argv) {
+  MPI_Instance mpi(&argc, &argv);
+
+  if (argc<5) {
+    printf("callback [file] [vertices] [iterations] [root]\n");
+    exit(-1);
+  }
+
+  Graph<Empty> * graph;
+  graph = new Graph<Empty>();
+  graph->load_directed(argv[1], std::atoi(argv[2]));
+  int iterations = std::atoi(argv[3]);
+  VertexId root = std::atoi(argv[4]);
+
+  // warm up the message buffers so neither variant pays for their allocation
+  double checksum;
+  pagerank<false>(graph, 1, checksum);
+
+  const char * callback_name[] = {"template", "function"};
+  for (int erased=0;erased<2;erased++) {
+    double exec_time = erased ? pagerank<true>(graph, iterations, checksum) : pagerank<false>(graph, iterations, checksum);
+    if (graph->partition_id==0) {
+      printf("app=pagerank callback=%s exec_time=%lf(s) per_edge=%lf(ns) checksum=%lf\n", callback_name[erased], exec_time, exec_time * 1e9 / ((double)graph->edges * iterations), checksum);
+    }
+  }
+  for (int erased=0;erased<2;erased++) {
+    double exec_time = erased ? bfs<true>(graph, root, checksum) : bfs<false>(graph, root, checksum);
+    if (graph->partition_id==0) {
+      printf("app=bfs callback=%s exec_time=%lf(s) per_edge=%lf(ns) checksum=%lf\n", callback_name[erased], exec_time, exec_time * 1e9 / graph->edges, checksum);
+    }
+  }
+
+  delete graph;
+  return 0;
+}
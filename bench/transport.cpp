@@ -0,0 +1,111 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "core/graph.hpp"
+
+// time one all-active process_edges superstep (one double per vertex) under each message transport and direction
+double run(Graph<Empty> * graph, MessageTransport transport, DirectionMode mode, int supersteps, double & checksum) {
+  double * curr = graph->alloc_vertex_array<double>();
+  double * next = graph->alloc_vertex_array<double>();
+  VertexSubset * active = graph->alloc_vertex_subset();
+  active->fill();
+  graph->fill_vertex_array(curr, (double)1);
+  graph->set_message_transport(transport);
+  graph->set_direction_mode(mode);
+
+  double exec_time = 0;
+  for (int step=0;step<=supersteps;step++) {
+    graph->fill_vertex_array(next, (double)0);
+    double superstep_time = 0;
+    superstep_time -= get_time();
+    graph->process_edges<int,double>(
+      [&](VertexId src){
+        graph->emit(src, curr[src]);
+      },
+      [&](VertexId src, double msg, VertexAdjList<Empty> outgoing_adj){
+        for (AdjUnit<Empty> * ptr=outgoing_adj.begin;ptr!=outgoing_adj.end;ptr++) {
+          VertexId dst = ptr->neighbour;
+          write_add(&next[dst], msg);
+        }
+        return 0;
+      },
+      [&](VertexId dst, VertexAdjList<Empty> incoming_adj) {
+        double sum = 0;
+        for (AdjUnit<Empty> * ptr=incoming_adj.begin;ptr!=incoming_adj.end;ptr++) {
+          VertexId src = ptr->neighbour;
+          sum += curr[src];
+        }
+        graph->emit(dst, sum);
+      },
+      [&](VertexId dst, double msg) {
+        write_add(&next[dst], msg);
+        return 0;
+      },
+      active
+    );
+    superstep_time += get_time();
+    // the first superstep sizes the message buffers and is not timed
+    if (step>0) {
+      exec_time += superstep_time;
+    }
+  }
+  checksum = graph->process_vertices<double>(
+    [&](VertexId vtx) {
+      return next[vtx];
+    },
+    active
+  );
+
+  graph->set_message_transport(ThreadedTransport);
+  graph->set_direction_mode(AutoDirection);
+  graph->dealloc_vertex_array(curr);
+  graph->dealloc_vertex_array(next);
+  delete active;
+  return exec_time / supersteps;
+}
+
+int main(int argc, char ** argv) {
+  MPI_Instance mpi(&argc, &argv);
+
+  if (argc<4) {
+    printf("transport [file] [vertices] [supersteps]\n");
+    exit(-1);
+  }
+
+  Graph<Empty> * graph;
+  graph = new Graph<Empty>();
+  graph->load_directed(argv[1], std::atoi(argv[2]));
+  int supersteps = std::atoi(argv[3]);
+
+  const char * transport_name[] = {"threaded", "nonblocking"};
+  const char * mode_name[] = {"auto", "sparse", "dense"};
+  DirectionMode modes[] = {SparseDirection, DenseDirection};
+  for (DirectionMode mode : modes) {
+    for (MessageTransport transport : {ThreadedTransport, NonblockingTransport}) {
+      double checksum;
+      double superstep_time = run(graph, transport, mode, supersteps, checksum);
+      if (graph->partition_id==0) {
+        printf("partitions=%d mode=%s transport=%s superstep=%lf(s) checksum=%lf\n", graph->partitions, mode_name[mode], transport_name[transport], superstep_time, checksum);
+      }
+    }
+  }
+
+  delete graph;
+  return 0;
+}
@@ -19,35 +19,165 @@ Copyright (c) 2015-2016 Xiaowei Zhu, Tsinghua University
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <assert.h>
 
+#include <type_traits>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+// atomics on any trivially copyable T of 1, 2, 4, 8 or 16 bytes, moved through an integer of the same width;
+// 16-byte values (e.g. a distance with its parent) use cmpxchg16b, which faults unless the value is 16-byte
+// aligned (declare such types alignas(16)). order is an __ATOMIC_* memory order;
+// values are compared bytewise, so T should have no padding.
+
+template <size_t size> struct AtomicWord;
+template <> struct AtomicWord<1> { typedef uint8_t type; };
+template <> struct AtomicWord<2> { typedef uint16_t type; };
+template <> struct AtomicWord<4> { typedef uint32_t type; };
+template <> struct AtomicWord<8> { typedef uint64_t type; };
+#ifdef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16
+template <> struct AtomicWord<16> { typedef unsigned __int128 type; };
+#endif
+
+template <class W>
+inline W atomic_load_word(W * ptr, int order) {
+  return __atomic_load_n(ptr, order);
+}
+
+template <class W>
+inline bool atomic_cas_word(W * ptr, W & expected, W desired, int order) {
+  return __atomic_compare_exchange_n(ptr, &expected, desired, false, order, __ATOMIC_RELAXED);
+}
+
+#ifdef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16
+// 16-byte __atomic builtins may go through libatomic locks; the __sync ones always inline cmpxchg16b (always seq_cst).
+// Aligned 16-byte vector loads are atomic on CPUs with AVX, so loads do not have to write the line;
+// without AVX the load falls back to a cmpxchg16b that rewrites the value it found
+inline unsigned __int128 atomic_load_word(unsigned __int128 * ptr, int order) {
+  assert(((uintptr_t)ptr & 15)==0);
+#ifdef __AVX__
+  // x86 loads already have acquire semantics; the asm keeps the compiler from caching or reordering it
+  __m128i word;
+  __asm__ __volatile__ ("vmovdqa %1, %0" : "=x" (word) : "m" (*(const __m128i *)ptr) : "memory");
+  unsigned __int128 val;
+  memcpy(&val, &word, sizeof(val));
+  return val;
+#else
+  return __sync_val_compare_and_swap(ptr, 0, 0);
+#endif
+}
+
+inline bool atomic_cas_word(unsigned __int128 * ptr, unsigned __int128 & expected, unsigned __int128 desired, int order) {
+  assert(((uintptr_t)ptr & 15)==0);
+  unsigned __int128 prev = __sync_val_compare_and_swap(ptr, expected, desired);
+  if (prev==expected) return true;
+  expected = prev;
+  return false;
+}
+#endif
+
 template <class T>
-inline bool cas(T * ptr, T old_val, T new_val) {
-  if (sizeof(T) == 8) {
-    return __sync_bool_compare_and_swap((long*)ptr, *((long*)&old_val), *((long*)&new_val));
-  } else if (sizeof(T) == 4) {
-    return __sync_bool_compare_and_swap((int*)ptr, *((int*)&old_val), *((int*)&new_val));
-  } else {
-    assert(false);
-  }
+inline typename AtomicWord<sizeof(T)>::type to_atomic_word(const T & val) {
+  static_assert(std::is_trivially_copyable<T>::value, "atomics need a trivially copyable type");
+  typename AtomicWord<sizeof(T)>::type word = 0;
+  memcpy(&word, &val, sizeof(T));
+  return word;
 }
 
 template <class T>
-inline bool write_min(T * ptr, T val) {
-  volatile T curr_val; bool done = false;
-  do {
-    curr_val = *ptr;
-  } while (curr_val > val && !(done = cas(ptr, curr_val, val)));
-  return done;
+inline T from_atomic_word(typename AtomicWord<sizeof(T)>::type word) {
+  T val;
+  memcpy(&val, &word, sizeof(T));
+  return val;
+}
+
+template <class T>
+inline T atomic_load(T * ptr, int order = __ATOMIC_SEQ_CST) {
+  typedef typename AtomicWord<sizeof(T)>::type W;
+  return from_atomic_word<T>(atomic_load_word((W *)ptr, order));
+}
+
+// replace *ptr by new_val if it still holds old_val
+template <class T>
+inline bool cas(T * ptr, T old_val, T new_val, int order = __ATOMIC_SEQ_CST) {
+  typedef typename AtomicWord<sizeof(T)>::type W;
+  W expected = to_atomic_word(old_val);
+  return atomic_cas_word((W *)ptr, expected, to_atomic_word(new_val), order);
+}
+
+// as cas, but on failure old_val is set to the value found in *ptr
+template <class T>
+inline bool compare_exchange(T * ptr, T & old_val, T new_val, int order = __ATOMIC_SEQ_CST) {
+  typedef typename AtomicWord<sizeof(T)>::type W;
+  W expected = to_atomic_word(old_val);
+  if (atomic_cas_word((W *)ptr, expected, to_atomic_word(new_val), order)) return true;
+  old_val = from_atomic_word<T>(expected);
+  return false;
+}
+
+// test-and-test-and-set: only attempt the (cache line stealing) cas if *ptr still reads old_val
+template <class T>
+inline bool ttas(T * ptr, T old_val, T new_val, int order = __ATOMIC_SEQ_CST) {
+  if (to_atomic_word(atomic_load(ptr, __ATOMIC_RELAXED))!=to_atomic_word(old_val)) return false;
+  return cas(ptr, old_val, new_val, order);
+}
+
+// lower *ptr to val; returns the previous value
+template <class T>
+inline T fetch_min(T * ptr, T val, int order = __ATOMIC_SEQ_CST) {
+  T curr_val = atomic_load(ptr, __ATOMIC_RELAXED);
+  while (val < curr_val && !compare_exchange(ptr, curr_val, val, order));
+  return curr_val;
+}
+
+// raise *ptr to val; returns the previous value
+template <class T>
+inline T fetch_max(T * ptr, T val, int order = __ATOMIC_SEQ_CST) {
+  T curr_val = atomic_load(ptr, __ATOMIC_RELAXED);
+  while (curr_val < val && !compare_exchange(ptr, curr_val, val, order));
+  return curr_val;
+}
+
+// true if this call lowered *ptr
+template <class T>
+inline bool write_min(T * ptr, T val, int order = __ATOMIC_SEQ_CST) {
+  return val < fetch_min(ptr, val, order);
+}
+
+// true if this call raised *ptr
+template <class T>
+inline bool write_max(T * ptr, T val, int order = __ATOMIC_SEQ_CST) {
+  return fetch_max(ptr, val, order) < val;
+}
+
+// monotone updates whose result is only read after the next barrier need no ordering
+template <class T>
+inline bool write_min_relaxed(T * ptr, T val) {
+  return write_min(ptr, val, __ATOMIC_RELAXED);
+}
+
+template <class T>
+inline bool write_max_relaxed(T * ptr, T val) {
+  return write_max(ptr, val, __ATOMIC_RELAXED);
+}
+
+// integers have a native atomic add
+template <class T>
+inline typename std::enable_if<std::is_integral<T>::value>::type write_add(T * ptr, T val) {
+  __atomic_fetch_add(ptr, val, __ATOMIC_RELAXED);
 }
 
+// other types retry a CAS; a failed CAS hands back the current value, so *ptr is not re-read
 template <class T>
-inline void write_add(T * ptr, T val) {
-  volatile T new_val, old_val;
+inline typename std::enable_if<!std::is_integral<T>::value>::type write_add(T * ptr, T val) {
+  T old_val, new_val;
+  __atomic_load(ptr, &old_val, __ATOMIC_RELAXED);
   do {
-    old_val = *ptr;
     new_val = old_val + val;
-  } while (!cas(ptr, old_val, new_val));
+  } while (!__atomic_compare_exchange(ptr, &old_val, &new_val, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
 }
 
 #endif
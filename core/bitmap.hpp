@@ -17,20 +17,59 @@ Copyright (c) 2015-2016 Xiaowei Zhu, Tsinghua University
 #ifndef BITMAP_HPP
 #define BITMAP_HPP
 
+#include <assert.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <numa.h>
+
+#include "core/constants.hpp"
+#include "core/type.hpp"
+
 #define WORD_OFFSET(i) ((i) >> 6)
 #define BIT_OFFSET(i) ((i) & 0x3f)
 
+// words are mmap-ed (page, hence cache-line, aligned) and can be bound to NUMA nodes before they are first touched
 class Bitmap {
+  size_t alloc_bytes() {
+    return (sizeof(unsigned long) * (WORD_OFFSET(size)+1) + PAGESIZE - 1) / PAGESIZE * PAGESIZE;
+  }
+  void alloc() {
+    data = (unsigned long *)mmap(NULL, alloc_bytes(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(data!=MAP_FAILED);
+  }
+  // bind the pages holding bits [begin, end) to socket s_i (pages on a boundary go to the last socket bound)
+  void bind(size_t begin, size_t end, int s_i) {
+    if (begin >= end) return;
+    char * begin_page = (char *)(data + WORD_OFFSET(begin)) - (size_t)(data + WORD_OFFSET(begin)) % PAGESIZE;
+    char * end_byte = (char *)(data + WORD_OFFSET(end - 1) + 1);
+    numa_tonode_memory(begin_page, end_byte - begin_page, s_i);
+  }
 public:
   size_t size;
   unsigned long * data;
   Bitmap() : size(0), data(NULL) { }
   Bitmap(size_t size) : size(size) {
-    data = new unsigned long [WORD_OFFSET(size)+1];
+    alloc();
+    clear();
+  }
+  // the whole bitmap on socket s_i (e.g. the adjacency bitmap scanned by that socket's threads)
+  Bitmap(size_t size, int s_i) : size(size) {
+    alloc();
+    numa_tonode_memory(data, alloc_bytes(), s_i);
+    clear();
+  }
+  // bits [offset[s_i], offset[s_i+1]) on socket s_i, the rest left to first touch
+  Bitmap(size_t size, const VertexId * offset, int sockets) : size(size) {
+    alloc();
+    for (int s_i=0;s_i<sockets;s_i++) {
+      bind(offset[s_i], offset[s_i+1], s_i);
+    }
     clear();
   }
   ~Bitmap() {
-    delete [] data;
+    if (data!=NULL) {
+      munmap(data, alloc_bytes());
+    }
   }
   void clear() {
     size_t bm_size = WORD_OFFSET(size);
@@ -56,8 +95,228 @@ public:
   void set_bit(size_t i) {
     __sync_fetch_and_or(data+WORD_OFFSET(i), 1ul<<BIT_OFFSET(i));
   }
+  // op(w_i, mask) for every word w_i covering bits [begin, end); mask selects the bits in range
+  // and is ~0 for all but the first and last word, so that the inner loop vectorizes
+  template <typename F>
+  void for_each_word(size_t begin, size_t end, F op) {
+    if (begin >= end) return;
+    size_t begin_word = WORD_OFFSET(begin);
+    size_t end_word = WORD_OFFSET(end - 1);
+    unsigned long begin_mask = ~0ul << BIT_OFFSET(begin);
+    unsigned long end_mask = ~0ul >> (63 - BIT_OFFSET(end - 1));
+    if (begin_word == end_word) {
+      op(begin_word, begin_mask & end_mask);
+      return;
+    }
+    op(begin_word, begin_mask);
+    #pragma omp parallel for
+    for (size_t w_i=begin_word+1;w_i<end_word;w_i++) {
+      op(w_i, ~0ul);
+    }
+    op(end_word, end_mask);
+  }
+  // bulk operations on the bits [begin, end) (usually the owned range), leaving the rest alone
+  void clear(size_t begin, size_t end) {
+    for_each_word(begin, end, [&](size_t w_i, unsigned long mask) {
+      data[w_i] &= ~mask;
+    });
+  }
+  void or_with(Bitmap * other, size_t begin, size_t end) {
+    for_each_word(begin, end, [&](size_t w_i, unsigned long mask) {
+      data[w_i] |= other->data[w_i] & mask;
+    });
+  }
+  void and_with(Bitmap * other, size_t begin, size_t end) {
+    for_each_word(begin, end, [&](size_t w_i, unsigned long mask) {
+      data[w_i] &= other->data[w_i] | ~mask;
+    });
+  }
+  // clear the bits that are set in other
+  void andnot(Bitmap * other, size_t begin, size_t end) {
+    for_each_word(begin, end, [&](size_t w_i, unsigned long mask) {
+      data[w_i] &= ~(other->data[w_i] & mask);
+    });
+  }
+  size_t count(size_t begin, size_t end) {
+    if (begin >= end) return 0;
+    size_t begin_word = WORD_OFFSET(begin);
+    size_t end_word = WORD_OFFSET(end - 1);
+    unsigned long begin_mask = ~0ul << BIT_OFFSET(begin);
+    unsigned long end_mask = ~0ul >> (63 - BIT_OFFSET(end - 1));
+    if (begin_word == end_word) {
+      return __builtin_popcountl(data[begin_word] & begin_mask & end_mask);
+    }
+    size_t bits = __builtin_popcountl(data[begin_word] & begin_mask) + __builtin_popcountl(data[end_word] & end_mask);
+    #pragma omp parallel for reduction(+:bits)
+    for (size_t w_i=begin_word+1;w_i<end_word;w_i++) {
+      bits += __builtin_popcountl(data[w_i]);
+    }
+    return bits;
+  }
+  size_t count() {
+    return count(0, size);
+  }
+  bool any(size_t begin, size_t end) {
+    if (begin >= end) return false;
+    size_t begin_word = WORD_OFFSET(begin);
+    size_t end_word = WORD_OFFSET(end - 1);
+    unsigned long begin_mask = ~0ul << BIT_OFFSET(begin);
+    unsigned long end_mask = ~0ul >> (63 - BIT_OFFSET(end - 1));
+    if (begin_word == end_word) {
+      return (data[begin_word] & begin_mask & end_mask) != 0;
+    }
+    unsigned long bits = (data[begin_word] & begin_mask) | (data[end_word] & end_mask);
+    #pragma omp parallel for reduction(|:bits)
+    for (size_t w_i=begin_word+1;w_i<end_word;w_i++) {
+      bits |= data[w_i];
+    }
+    return bits != 0;
+  }
+  // take over the bits of other (e.g. next frontier -> current frontier) and hand it this bitmap's words,
+  // cleared in [begin, end); bits outside the range must already be clear
+  void swap_and_clear(Bitmap * other, size_t begin, size_t end) {
+    assert(size == other->size);
+    std::swap(data, other->data);
+    other->clear(begin, end);
+  }
+  // call process(i) for every set bit i in [begin, end), in increasing order
+  template <typename F>
+  void for_each_bit(size_t begin, size_t end, F process) {
+    if (begin >= end) return;
+    size_t begin_word = WORD_OFFSET(begin);
+    size_t end_word = WORD_OFFSET(end - 1);
+    for (size_t w_i=begin_word;w_i<=end_word;) {
+      // skip runs of empty words four at a time
+      if (w_i + 4 <= end_word && (data[w_i] | data[w_i+1] | data[w_i+2] | data[w_i+3]) == 0) {
+        w_i += 4;
+        continue;
+      }
+      unsigned long word = data[w_i];
+      if (w_i == begin_word) word &= ~0ul << BIT_OFFSET(begin);
+      if (w_i == end_word) word &= ~0ul >> (63 - BIT_OFFSET(end - 1));
+      size_t base = w_i << 6;
+      while (word != 0) {
+        process(base + __builtin_ctzl(word));
+        word &= word - 1;
+      }
+      w_i++;
+    }
+  }
 };
 
-typedef Bitmap VertexSubset;
+// a Bitmap that also lists its set bits while at most size/64 of them are set,
+// so that small frontiers are cleared and scanned in O(set bits) instead of O(size/64);
+// bits must be set through VertexSubset::set_bit to be listed; code that writes data directly
+// (e.g. the dense_selective sync in process_edges) has to call mark_dense afterwards
+class VertexSubset : public Bitmap {
+public:
+  VertexId * list;
+  size_t list_capacity;
+  size_t list_size; // exceeds list_capacity once the subset is dense
+  VertexSubset(size_t size) : Bitmap(size) {
+    init_list();
+  }
+  VertexSubset(size_t size, const VertexId * offset, int sockets) : Bitmap(size, offset, sockets) {
+    init_list();
+  }
+  void init_list() {
+    list_capacity = size / 64;
+    list = new VertexId [list_capacity + 1];
+    list_size = 0;
+  }
+  ~VertexSubset() {
+    delete [] list;
+  }
+  bool is_sparse() {
+    return list_size <= list_capacity;
+  }
+  // stop trusting the list, e.g. after the words were written directly
+  void mark_dense() {
+    list_size = list_capacity + 1;
+  }
+  void clear() {
+    if (is_sparse()) {
+      #pragma omp parallel for if (list_size > 4096)
+      for (size_t l_i=0;l_i<list_size;l_i++) {
+        data[WORD_OFFSET(list[l_i])] = 0;
+      }
+    } else {
+      Bitmap::clear();
+    }
+    list_size = 0;
+  }
+  // clear the bits in [begin, end); a sparse subset drops them from its list as well
+  void clear(size_t begin, size_t end) {
+    if (!is_sparse()) {
+      Bitmap::clear(begin, end);
+      return;
+    }
+    size_t kept = 0;
+    for (size_t l_i=0;l_i<list_size;l_i++) {
+      VertexId v_i = list[l_i];
+      if (v_i >= begin && v_i < end) {
+        data[WORD_OFFSET(v_i)] &= ~(1ul << BIT_OFFSET(v_i));
+      } else {
+        list[kept++] = v_i;
+      }
+    }
+    list_size = kept;
+  }
+  void fill() {
+    Bitmap::fill();
+    mark_dense();
+  }
+  void set_bit(size_t i) {
+    if (!is_sparse()) {
+      Bitmap::set_bit(i);
+      return;
+    }
+    unsigned long bit = 1ul << BIT_OFFSET(i);
+    if (__sync_fetch_and_or(data+WORD_OFFSET(i), bit) & bit) return;
+    size_t pos = __sync_fetch_and_add(&list_size, 1);
+    if (pos < list_capacity) {
+      list[pos] = i;
+    }
+  }
+  size_t count() {
+    return count(0, size);
+  }
+  // sparse subsets count their list
+  size_t count(size_t begin, size_t end) {
+    if (!is_sparse()) {
+      return Bitmap::count(begin, end);
+    }
+    size_t bits = 0;
+    for (size_t l_i=0;l_i<list_size;l_i++) {
+      bits += (list[l_i] >= begin && list[l_i] < end);
+    }
+    return bits;
+  }
+  // the word-wise updates do not maintain the list, so they leave the subset dense
+  void or_with(Bitmap * other, size_t begin, size_t end) {
+    Bitmap::or_with(other, begin, end);
+    mark_dense();
+  }
+  void and_with(Bitmap * other, size_t begin, size_t end) {
+    Bitmap::and_with(other, begin, end);
+    mark_dense();
+  }
+  void andnot(Bitmap * other, size_t begin, size_t end) {
+    Bitmap::andnot(other, begin, end);
+    mark_dense();
+  }
+  void swap_and_clear(VertexSubset * other, size_t begin, size_t end) {
+    assert(size == other->size);
+    std::swap(data, other->data);
+    std::swap(list, other->list);
+    std::swap(list_size, other->list_size);
+    if (other->is_sparse()) {
+      other->clear();
+    } else {
+      other->Bitmap::clear(begin, end);
+      other->list_size = 0;
+    }
+  }
+};
 
 #endif
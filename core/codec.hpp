@@ -0,0 +1,116 @@
+/*
+Copyright (c) 2015-2016 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef CODEC_HPP
+#define CODEC_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+// map signed deltas to unsigned so that small magnitudes stay small
+inline uint64_t zigzag_encode(int64_t v) {
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+inline int64_t zigzag_decode(uint64_t v) {
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// bytes taken by v as a base-128 varint
+inline size_t varint_size(uint64_t v) {
+  size_t bytes = 1;
+  while (v >= 0x80) {
+    v >>= 7;
+    bytes++;
+  }
+  return bytes;
+}
+
+// write v as a little-endian base-128 varint; returns the end of the written bytes
+inline unsigned char * encode_varint(unsigned char * out, uint64_t v) {
+  while (v >= 0x80) {
+    *out++ = (unsigned char)(v | 0x80);
+    v >>= 7;
+  }
+  *out++ = (unsigned char)v;
+  return out;
+}
+
+// read a base-128 varint into v; returns the end of the consumed bytes
+inline const unsigned char * decode_varint(const unsigned char * in, uint64_t & v) {
+  uint64_t byte = *in++;
+  v = byte;
+  if (byte < 0x80) return in; // most deltas fit in one byte
+  v &= 0x7f;
+  int shift = 7;
+  do {
+    byte = *in++;
+    v |= (byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte >= 0x80);
+  return in;
+}
+
+// upper bound of the encoded size of count message units of unit_size bytes
+inline size_t max_encoded_messages_size(size_t count, size_t unit_size) {
+  return 10 + count * (unit_size + 1);
+}
+
+// encode count message units, each a 32-bit vertex id followed by its payload:
+// the count, then per unit the zigzag varint delta from the previous vertex id and the raw payload;
+// returns the encoded size
+inline size_t encode_messages(const char * units, size_t count, size_t unit_size, unsigned char * out) {
+  unsigned char * begin = out;
+  out = encode_varint(out, count);
+  uint32_t prev = 0;
+  for (size_t u_i=0;u_i<count;u_i++) {
+    const char * unit = units + unit_size * u_i;
+    uint32_t vertex;
+    memcpy(&vertex, unit, sizeof(uint32_t));
+    out = encode_varint(out, zigzag_encode((int64_t)vertex - prev));
+    prev = vertex;
+    memcpy(out, unit + sizeof(uint32_t), unit_size - sizeof(uint32_t));
+    out += unit_size - sizeof(uint32_t);
+  }
+  return out - begin;
+}
+
+// decode the output of encode_messages into units, which holds at most max_count of them;
+// returns the number of message units
+inline size_t decode_messages(const unsigned char * in, size_t bytes, size_t unit_size, char * units, size_t max_count) {
+  const unsigned char * end = in + bytes;
+  uint64_t count;
+  in = decode_varint(in, count);
+  // check the count before writing anything: every unit takes at least one delta byte plus its payload
+  assert(count <= max_count);
+  assert(count * (unit_size - sizeof(uint32_t) + 1) <= (size_t)(end - in));
+  uint32_t prev = 0;
+  for (size_t u_i=0;u_i<count;u_i++) {
+    char * unit = units + unit_size * u_i;
+    uint64_t delta;
+    in = decode_varint(in, delta);
+    uint32_t vertex = (uint32_t)((int64_t)prev + zigzag_decode(delta));
+    memcpy(unit, &vertex, sizeof(uint32_t));
+    prev = vertex;
+    memcpy(unit + sizeof(uint32_t), in, unit_size - sizeof(uint32_t));
+    in += unit_size - sizeof(uint32_t);
+  }
+  assert(in == end);
+  return count;
+}
+
+#endif
@@ -19,5 +19,13 @@ Copyright (c) 2015-2016 Xiaowei Zhu, Tsinghua University
 
 #define CHUNKSIZE (1<<20)
 #define PAGESIZE (1<<12)
+#define VERTEX_CHUNK (1<<10)
+#define SHUFFLE_BUFFERS 4
+#define SNAPSHOT_VERSION 2
+#define SPARSE_EDGE_COST 20
+#define DIRECTION_HYSTERESIS 1.25
+#define DIRECTION_HISTORY 64
+#define READY_QUEUE_SPINS (1<<12)
+#define REDUCTION_HUBS (1<<16)
 
 #endif
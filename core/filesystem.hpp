@@ -21,9 +21,14 @@ Copyright (c) 2015-2016 Xiaowei Zhu, Tsinghua University
 #include <stdlib.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <string>
+
 inline bool file_exists(std::string filename) {
   struct stat st;
   return stat(filename.c_str(), &st)==0;
@@ -35,4 +40,46 @@ inline long file_size(std::string filename) {
   return st.st_size;
 }
 
+// a read-only shared mapping of [offset, offset+length) of a file
+class MappedFile {
+  char * base;
+  size_t mapped_length;
+  size_t page_offset;
+public:
+  char * data;
+  size_t length;
+  MappedFile(std::string filename, long offset, long length, bool populate = true) : length(length) {
+    long page_size = sysconf(_SC_PAGESIZE);
+    page_offset = offset % page_size;
+    mapped_length = page_offset + length;
+    base = NULL;
+    data = NULL;
+    if (length==0) return;
+    int fd = open(filename.c_str(), O_RDONLY);
+    assert(fd!=-1);
+    base = (char *)mmap(NULL, mapped_length, PROT_READ, MAP_SHARED | (populate ? MAP_POPULATE : 0), fd, offset - page_offset);
+    assert(base!=MAP_FAILED);
+    assert(close(fd)==0);
+    madvise(base, mapped_length, MADV_SEQUENTIAL);
+    data = base + page_offset;
+  }
+  MappedFile(const MappedFile &) = delete;
+  MappedFile & operator=(const MappedFile &) = delete;
+  ~MappedFile() {
+    if (base!=NULL) {
+      assert(munmap(base, mapped_length)==0);
+    }
+  }
+  // start reading [begin, begin+bytes) ahead asynchronously
+  void prefetch(size_t begin, size_t bytes) {
+    if (begin >= length) return;
+    if (bytes > length - begin) {
+      bytes = length - begin;
+    }
+    long page_size = sysconf(_SC_PAGESIZE);
+    size_t aligned_begin = (page_offset + begin) / page_size * page_size;
+    madvise(base + aligned_begin, page_offset + begin + bytes - aligned_begin, MADV_WILLNEED);
+  }
+};
+
 #endif
\ No newline at end of file
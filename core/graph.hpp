@@ -28,16 +28,22 @@ Copyright (c) 2015-2016 Xiaowei Zhu, Tsinghua University
 #include <omp.h>
 
 #include <string>
+#include <map>
+#include <algorithm>
+#include <parallel/algorithm>
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <functional>
 
 #include "core/atomic.hpp"
 #include "core/bitmap.hpp"
+#include "core/codec.hpp"
 #include "core/constants.hpp"
 #include "core/filesystem.hpp"
 #include "core/mpi.hpp"
+#include "core/queue.hpp"
 #include "core/time.hpp"
 #include "core/type.hpp"
 
@@ -46,6 +52,36 @@ enum ThreadStatus {
   STEALING
 };
 
+enum PartitionCost {
+  OutDegreeCost,
+  InDegreeCost,
+  MixedDegreeCost,
+  MeasuredCost
+};
+
+enum VertexOrder {
+  OriginalOrder,
+  DegreeSortOrder,
+  HubClusterOrder
+};
+
+enum DirectionMode {
+  AutoDirection,
+  SparseDirection,
+  DenseDirection
+};
+
+enum ReductionStrategy {
+  AtomicReduction,        // CAS straight into the array
+  SocketLocalReduction,   // CAS into the array for vertices of the caller's socket, into a socket-local accumulator otherwise
+  ThreadPrivateReduction  // plain adds into per-thread partial sums for the highest in-degree vertices, CAS otherwise
+};
+
+enum MessageTransport {
+  ThreadedTransport,
+  NonblockingTransport
+};
+
 enum MessageTag {
   ShuffleGraph,
   PassMessage,
@@ -80,8 +116,112 @@ struct MessageBuffer {
       capacity = new_capacity;
     }
   }
+  void release() {
+    if (data!=NULL) {
+      numa_free(data, capacity);
+    }
+    capacity = 0;
+    count = 0;
+    data = NULL;
+  }
+};
+
+#define NOT_A_HUB ((VertexId)-1)
+
+// add-reduction into the owned range of a vertex array; partial sums are folded in by merge_add_reduction
+template <typename T>
+struct AddReduction {
+  T * array; // may be pointed at another vertex array between supersteps
+  ReductionStrategy strategy;
+  VertexId begin; // first owned vertex; partial[s][v_i - begin] for SocketLocalReduction
+  int parts;
+  T ** partial; // [sockets] [owned vertices] or [threads] [hubs]
+  VertexId hubs; // ThreadPrivateReduction: number of privatized vertices
+  VertexId * hub_vertex; // [hubs]
+  VertexId * hub_slot; // [owned vertices]; partial[t][hub_slot[v_i - begin]], or NOT_A_HUB
+};
+
+// outstanding nonblocking sends / receives of one process_edges call; [partition * sockets + socket]
+struct MessageRequests {
+  int partitions;
+  int sockets;
+  MPI_Request * send;
+  MPI_Request * recv;
+  int * pending; // socket buffers not yet received, per partition
+  MessageRequests(int partitions, int sockets) : partitions(partitions), sockets(sockets) {
+    send = new MPI_Request [partitions * sockets];
+    recv = new MPI_Request [partitions * sockets];
+    pending = new int [partitions];
+    for (int i=0;i<partitions * sockets;i++) {
+      send[i] = MPI_REQUEST_NULL;
+      recv[i] = MPI_REQUEST_NULL;
+    }
+    for (int i=0;i<partitions;i++) {
+      pending[i] = sockets;
+    }
+  }
+  ~MessageRequests() {
+    delete [] send;
+    delete [] recv;
+    delete [] pending;
+  }
+};
+
+// per-job message buffers kept across supersteps; capacities only grow
+struct MessageBufferPool {
+  bool initialized;
+  ThreadState ** thread_state; // ThreadState* [threads]; numa-aware
+  MessageBuffer ** local_send_buffer; // MessageBuffer* [threads]; numa-aware
+  MessageBuffer *** send_buffer; // MessageBuffer* [partitions] [sockets]; numa-aware
+  MessageBuffer *** recv_buffer; // MessageBuffer* [partitions] [sockets]; numa-aware
+  MessageBuffer *** wire_send_buffer; // MessageBuffer* [partitions] [sockets]; numa-aware; encoded send_buffer
+  MessageBuffer *** wire_recv_buffer; // MessageBuffer* [partitions] [sockets]; numa-aware; encoded recv_buffer
+  unsigned long * combine_owner; // unsigned long [vertices]; interleaved; allocated once a combiner is used
+  MessageBufferPool () {
+    initialized = false;
+    thread_state = NULL;
+    local_send_buffer = NULL;
+    send_buffer = NULL;
+    recv_buffer = NULL;
+    wire_send_buffer = NULL;
+    wire_recv_buffer = NULL;
+    combine_owner = NULL;
+  }
+};
+
+// inputs and outcome of the sparse/dense decision of one process_edges call
+struct DirectionStats {
+  VertexId active_vertices; // over all partitions
+  EdgeId active_edges; // out-degree sum of the active vertices
+  size_t message_size; // bytes per message unit
+  int partitions;
+  bool sparse;
+  double time; // seconds spent in process_edges, measured on this partition
 };
 
+// traffic of the message codec; sizes count every send
+struct CodecStats {
+  uint64_t raw_bytes;
+  uint64_t wire_bytes;
+  double encode_time;
+  double decode_time;
+};
+
+// leading block of a per-partition graph snapshot file
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  int32_t partitions;
+  int32_t partition_id;
+  int32_t sockets;
+  int32_t threads;
+  int32_t symmetric;
+  int32_t vertex_order;
+  uint64_t edge_unit_size;
+  VertexId vertices;
+  EdgeId edges;
+} __attribute__((packed));
+
 template <typename MsgData>
 struct MsgUnit {
   VertexId vertex;
@@ -95,6 +235,11 @@ public:
   int partitions;
 
   size_t alpha;
+  PartitionCost partition_cost; // per-vertex cost balanced across partitions (plus alpha)
+  EdgeId * measured_vertex_cost; // EdgeId [vertices]; the same on all partitions; used by MeasuredCost
+  VertexOrder vertex_order; // relabeling applied between degree counting and partitioning
+  VertexId * reorder_forward; // VertexId [vertices]; original id -> internal id; nullptr if not reordered
+  VertexId * reorder_backward; // VertexId [vertices]; internal id -> original id; nullptr if not reordered
 
   int threads;
   int sockets;
@@ -129,6 +274,10 @@ public:
   VertexId * compressed_outgoing_adj_vertices;
   CompressedAdjIndexUnit ** compressed_outgoing_adj_index; // CompressedAdjIndexUnit [sockets] [...+1]; numa-aware
 
+  bool encoded_adj; // adjacency lists replaced by byte streams; adj indices then hold byte offsets
+  unsigned char ** incoming_adj_stream; // unsigned char [sockets] [...]; numa-aware
+  unsigned char ** outgoing_adj_stream; // unsigned char [sockets] [...]; numa-aware
+
   ThreadState **tuned_chunks_dense;  // ThreadState [partitions][threads];
   ThreadState **tuned_chunks_sparse; // ThreadState [partitions][threads];
 
@@ -137,6 +286,23 @@ public:
   MessageBuffer** local_send_buffer_loc[8];
   MessageBuffer*** send_buffer_loc[8];
   int part_id_val[8];
+  MessageBufferPool buffer_pool[8];
+
+  DirectionMode direction_mode[8];
+  std::function<bool(const DirectionStats &, const std::vector<DirectionStats> &)> direction_policy[8];
+  std::vector<DirectionStats> direction_history[8];
+
+  std::function<void(void *, const void *)> message_combiner[8]; // merges the second message into the first
+  size_t message_combiner_size[8];
+
+  bool message_compression[8];
+  bool dense_overlap[8];
+  MessageTransport message_transport[8];
+  CodecStats codec_stats[8];
+  std::mutex codec_stats_mutex;
+
+  std::mutex vertex_thread_state_mutex;
+  std::map<std::thread::id, ThreadState **> vertex_thread_state; // ThreadState* [threads] per calling thread; numa-aware
 
   Graph() {
     threads = numa_num_configured_cpus();
@@ -146,6 +312,18 @@ public:
     init();
   }
 
+  ~Graph() {
+    for (int id=0;id<8;id++) {
+      free_message_buffers(id);
+    }
+    for (auto & entry : vertex_thread_state) {
+      for (int t_i=0;t_i<threads;t_i++) {
+        numa_free(entry.second[t_i], sizeof(ThreadState));
+      }
+      delete [] entry.second;
+    }
+  }
+
   inline int get_socket_id(int thread_id) {
     return thread_id / threads_per_socket;
   }
@@ -201,6 +379,23 @@ public:
     MPI_Comm_size(MPI_COMM_WORLD, &partitions);
 
     alpha = 8 * (partitions - 1);
+    partition_cost = OutDegreeCost;
+    measured_vertex_cost = nullptr;
+    vertex_order = OriginalOrder;
+    reorder_forward = nullptr;
+    reorder_backward = nullptr;
+    encoded_adj = false;
+    incoming_adj_stream = nullptr;
+    outgoing_adj_stream = nullptr;
+    for (int id=0;id<8;id++) {
+      direction_mode[id] = AutoDirection;
+      message_combiner_size[id] = 0;
+      message_compression[id] = false;
+      dense_overlap[id] = false;
+      message_transport[id] = ThreadedTransport;
+      memset(&codec_stats[id], 0, sizeof(CodecStats));
+    }
+    get_vertex_thread_state();
 
     MPI_Barrier(MPI_COMM_WORLD);
   }
@@ -227,10 +422,129 @@ public:
 
   // deallocate a vertex array
   template<typename T>
-  T * dealloc_vertex_array(T * array) {
+  void dealloc_vertex_array(T * array) {
     numa_free(array, sizeof(T) * vertices);
   }
 
+  // accumulate slot updates to the owned vertices of array through strategy
+  template<typename T>
+  // SocketLocalReduction takes sockets * owned_vertices * sizeof(T) bytes; ThreadPrivateReduction only privatizes
+  // the (at most REDUCTION_HUBS) owned vertices with the highest in-degree, where CAS contention concentrates,
+  // and takes threads * hubs * sizeof(T) bytes plus an owned_vertices-long slot index
+  AddReduction<T> * alloc_add_reduction(T * array, ReductionStrategy strategy) {
+    AddReduction<T> * reduction = new AddReduction<T>;
+    reduction->array = array;
+    reduction->strategy = strategy;
+    reduction->begin = partition_offset[partition_id];
+    reduction->parts = 0;
+    reduction->hubs = 0;
+    reduction->hub_vertex = nullptr;
+    reduction->hub_slot = nullptr;
+    VertexId partial_size = owned_vertices;
+    if (strategy==SocketLocalReduction) {
+      reduction->parts = sockets;
+    } else if (strategy==ThreadPrivateReduction) {
+      reduction->parts = threads;
+      std::vector<VertexId> candidates;
+      for (VertexId v_i=partition_offset[partition_id];v_i<partition_offset[partition_id+1];v_i++) {
+        if (in_degree[v_i] > 1) {
+          candidates.push_back(v_i);
+        }
+      }
+      VertexId hubs = std::min((VertexId)candidates.size(), (VertexId)REDUCTION_HUBS);
+      std::partial_sort(candidates.begin(), candidates.begin() + hubs, candidates.end(), [&](VertexId a, VertexId b) {
+        return in_degree[a] > in_degree[b];
+      });
+      reduction->hubs = hubs;
+      reduction->hub_vertex = new VertexId [hubs];
+      reduction->hub_slot = new VertexId [owned_vertices];
+      std::fill(reduction->hub_slot, reduction->hub_slot + owned_vertices, NOT_A_HUB);
+      for (VertexId h_i=0;h_i<hubs;h_i++) {
+        reduction->hub_vertex[h_i] = candidates[h_i];
+        reduction->hub_slot[candidates[h_i] - reduction->begin] = h_i;
+      }
+      partial_size = hubs;
+    }
+    reduction->partial = new T * [reduction->parts];
+    for (int p_i=0;p_i<reduction->parts;p_i++) {
+      int s_i = (strategy==ThreadPrivateReduction) ? get_socket_id(p_i) : p_i;
+      reduction->partial[p_i] = (T *)numa_alloc_onnode(sizeof(T) * std::max(partial_size, (VertexId)1), s_i);
+      assert(reduction->partial[p_i]!=NULL);
+      memset(reduction->partial[p_i], 0, sizeof(T) * partial_size);
+    }
+    return reduction;
+  }
+
+  // deallocate an add-reduction (the array itself is left alone)
+  template<typename T>
+  void dealloc_add_reduction(AddReduction<T> * reduction) {
+    VertexId partial_size = (reduction->strategy==ThreadPrivateReduction) ? reduction->hubs : owned_vertices;
+    for (int p_i=0;p_i<reduction->parts;p_i++) {
+      numa_free(reduction->partial[p_i], sizeof(T) * std::max(partial_size, (VertexId)1));
+    }
+    delete [] reduction->partial;
+    delete [] reduction->hub_vertex;
+    delete [] reduction->hub_slot;
+    delete reduction;
+  }
+
+  // add val to array[v_i] (v_i must be owned) from inside process_edges / process_vertices
+  template<typename T>
+  inline void reduce_add(AddReduction<T> * reduction, VertexId v_i, T val) {
+    int t_i = omp_get_thread_num();
+    switch (reduction->strategy) {
+      case ThreadPrivateReduction: {
+        VertexId h_i = reduction->hub_slot[v_i - reduction->begin];
+        if (h_i==NOT_A_HUB) {
+          write_add(&reduction->array[v_i], val);
+        } else {
+          reduction->partial[t_i][h_i] += val;
+        }
+        break;
+      }
+      case SocketLocalReduction: {
+        int s_i = get_socket_id(t_i);
+        if (v_i >= local_partition_offset[s_i] && v_i < local_partition_offset[s_i+1]) {
+          write_add(&reduction->array[v_i], val);
+        } else {
+          write_add(&reduction->partial[s_i][v_i - reduction->begin], val);
+        }
+        break;
+      }
+      default:
+        write_add(&reduction->array[v_i], val);
+    }
+  }
+
+  // fold the partial sums into the array and reset them; call after the process_edges that reduced into it
+  template<typename T>
+  void merge_add_reduction(AddReduction<T> * reduction) {
+    if (reduction->parts==0) return;
+    if (reduction->strategy==ThreadPrivateReduction) {
+      #pragma omp parallel for
+      for (VertexId h_i=0;h_i<reduction->hubs;h_i++) {
+        T sum = 0;
+        for (int p_i=0;p_i<reduction->parts;p_i++) {
+          sum += reduction->partial[p_i][h_i];
+          reduction->partial[p_i][h_i] = 0;
+        }
+        reduction->array[reduction->hub_vertex[h_i]] += sum;
+      }
+      return;
+    }
+    #pragma omp parallel for
+    for (VertexId begin_v_i=partition_offset[partition_id];begin_v_i<partition_offset[partition_id+1];begin_v_i+=VERTEX_CHUNK) {
+      VertexId end_v_i = std::min(begin_v_i + VERTEX_CHUNK, partition_offset[partition_id+1]);
+      for (int p_i=0;p_i<reduction->parts;p_i++) {
+        T * partial = reduction->partial[p_i];
+        for (VertexId v_i=begin_v_i;v_i<end_v_i;v_i++) {
+          reduction->array[v_i] += partial[v_i - reduction->begin];
+          partial[v_i - reduction->begin] = 0;
+        }
+      }
+    }
+  }
+
   // allocate a numa-oblivious vertex array
   template<typename T>
   T * alloc_interleaved_vertex_array() {
@@ -295,7 +609,8 @@ public:
     assert(close(fd)==0);
   }
 
-  // gather a vertex array
+  // gather a vertex array; on root it comes back indexed by original ids, but stored vertex ids
+  // (e.g. BFS parents or CC labels) remain internal ids until mapped through get_original_vertex_id
   template<typename T>
   void gather_vertex_array(T * array, int root) {
     if (partition_id!=root) {
@@ -309,12 +624,35 @@ public:
         MPI_Get_count(&recv_status, MPI_CHAR, &length);
         assert(length == sizeof(T) * (partition_offset[i + 1] - partition_offset[i]));
       }
+      if (reorder_backward!=nullptr) {
+        // hand the array back indexed by original ids
+        T * original_array = new T [vertices];
+        #pragma omp parallel for
+        for (VertexId v_i=0;v_i<vertices;v_i++) {
+          original_array[reorder_backward[v_i]] = array[v_i];
+        }
+        #pragma omp parallel for
+        for (VertexId v_i=0;v_i<vertices;v_i++) {
+          array[v_i] = original_array[v_i];
+        }
+        delete [] original_array;
+      }
     }
   }
 
   // allocate a vertex subset
   VertexSubset * alloc_vertex_subset() {
-    return new VertexSubset(vertices);
+    return new VertexSubset(vertices, local_partition_offset, sockets);
+  }
+
+  // number of vertices set in a bitmap / subset across all partitions; each partition popcounts its
+  // owned range, so no process_vertices superstep is needed
+  template <typename B>
+  size_t count_vertices(B * bitmap) {
+    size_t local_count = bitmap->count(partition_offset[partition_id], partition_offset[partition_id+1]);
+    size_t global_count;
+    MPI_Allreduce(&local_count, &global_count, 1, get_mpi_data_type<size_t>(), MPI_SUM, MPI_COMM_WORLD);
+    return global_count;
   }
 
   int get_partition_id(VertexId v_i){
@@ -335,6 +673,152 @@ public:
     assert(false);
   }
 
+  // internal id of a vertex given its id in the input file
+  VertexId get_internal_vertex_id(VertexId v_i) {
+    return reorder_forward==nullptr ? v_i : reorder_forward[v_i];
+  }
+
+  // id in the input file of an internal vertex id
+  VertexId get_original_vertex_id(VertexId v_i) {
+    return reorder_backward==nullptr ? v_i : reorder_backward[v_i];
+  }
+
+  // map an edge read from the input file to internal ids
+  inline void relabel_edge(EdgeUnit<EdgeData> & edge) {
+    if (reorder_forward!=nullptr) {
+      edge.src = reorder_forward[edge.src];
+      edge.dst = reorder_forward[edge.dst];
+    }
+  }
+
+  // build the vertex_order relabeling from global degrees (identical on all partitions)
+  void reorder_vertices(VertexId * degree) {
+    if (vertex_order==OriginalOrder) {
+      return;
+    }
+    reorder_backward = alloc_interleaved_vertex_array<VertexId>();
+    #pragma omp parallel for
+    for (VertexId v_i=0;v_i<vertices;v_i++) {
+      reorder_backward[v_i] = v_i;
+    }
+    if (vertex_order==DegreeSortOrder) {
+      // descending degree; ties keep their original order
+      __gnu_parallel::stable_sort(reorder_backward, reorder_backward + vertices, [&](VertexId a, VertexId b) {
+        return degree[a] > degree[b];
+      });
+    } else if (vertex_order==HubClusterOrder) {
+      // vertices above the average degree first; both groups keep their original order
+      EdgeId total_degree = 0;
+      #pragma omp parallel for reduction(+:total_degree)
+      for (VertexId v_i=0;v_i<vertices;v_i++) {
+        total_degree += degree[v_i];
+      }
+      EdgeId average_degree = total_degree / vertices;
+      std::stable_partition(reorder_backward, reorder_backward + vertices, [&](VertexId v_i) {
+        return degree[v_i] > average_degree;
+      });
+    }
+    reorder_forward = alloc_interleaved_vertex_array<VertexId>();
+    #pragma omp parallel for
+    for (VertexId v_i=0;v_i<vertices;v_i++) {
+      reorder_forward[reorder_backward[v_i]] = v_i;
+    }
+  }
+
+  // move a global array indexed by original ids to internal ids
+  template<typename T>
+  void relabel_global_array(T * array) {
+    if (reorder_backward==nullptr) {
+      return;
+    }
+    T * original_array = new T [vertices];
+    #pragma omp parallel for
+    for (VertexId v_i=0;v_i<vertices;v_i++) {
+      original_array[v_i] = array[v_i];
+    }
+    #pragma omp parallel for
+    for (VertexId v_i=0;v_i<vertices;v_i++) {
+      array[v_i] = original_array[reorder_backward[v_i]];
+    }
+    delete [] original_array;
+  }
+
+  // cost of a vertex under the partitioning cost model
+  EdgeId get_partition_vertex_cost(VertexId v_i, VertexId * global_out_degree, VertexId * global_in_degree) {
+    switch (partition_cost) {
+      case InDegreeCost:
+        return global_in_degree[v_i];
+      case MixedDegreeCost:
+        return (EdgeId)global_out_degree[v_i] + global_in_degree[v_i];
+      case MeasuredCost:
+        assert(measured_vertex_cost!=nullptr);
+        return measured_vertex_cost[get_original_vertex_id(v_i)];
+      default:
+        return global_out_degree[v_i];
+    }
+  }
+
+  // split [begin, end) into parts page-aligned ranges of balanced cost
+  // each range is closed at the first vertex whose cost exceeds its share of the remaining cost
+  template<typename F>
+  void balanced_partition(VertexId begin, VertexId end, int parts, F cost, VertexId * offset) {
+    // block_cost[b_i] holds the cost of [begin, begin + b_i * basic_block); vertices are only rescanned within one block
+    const VertexId basic_block = PAGESIZE * 16;
+    VertexId blocks = (end - begin + basic_block - 1) / basic_block;
+    EdgeId * block_cost = new EdgeId [blocks + 1];
+    block_cost[0] = 0;
+    #pragma omp parallel for schedule(dynamic)
+    for (VertexId b_i=0;b_i<blocks;b_i++) {
+      VertexId block_end = std::min(end, begin + (b_i + 1) * basic_block);
+      EdgeId sum = 0;
+      for (VertexId v_i=begin+b_i*basic_block;v_i<block_end;v_i++) {
+        sum += cost(v_i);
+      }
+      block_cost[b_i+1] = sum;
+    }
+    for (VertexId b_i=0;b_i<blocks;b_i++) {
+      block_cost[b_i+1] += block_cost[b_i];
+    }
+    auto prefix_cost = [&](VertexId v_i) {
+      VertexId b_i = (v_i - begin) / basic_block;
+      EdgeId sum = block_cost[b_i];
+      for (VertexId u_i=begin+b_i*basic_block;u_i<v_i;u_i++) {
+        sum += cost(u_i);
+      }
+      return sum;
+    };
+    offset[0] = begin;
+    EdgeId remained_amount = block_cost[blocks];
+    for (int i=0;i<parts;i++) {
+      int remained_partitions = parts - i;
+      EdgeId expected_chunk_size = remained_amount / remained_partitions;
+      EdgeId begin_cost = prefix_cost(offset[i]);
+      if (remained_partitions==1) {
+        offset[i+1] = end;
+      } else {
+        EdgeId target = begin_cost + expected_chunk_size;
+        VertexId b_i = std::upper_bound(block_cost, block_cost + blocks + 1, target) - block_cost - 1;
+        offset[i+1] = end;
+        if (b_i < blocks) {
+          EdgeId got_cost = block_cost[b_i];
+          for (VertexId v_i=begin+b_i*basic_block;v_i<end;v_i++) {
+            got_cost += cost(v_i);
+            if (got_cost > target) {
+              offset[i+1] = v_i;
+              break;
+            }
+          }
+        }
+        offset[i+1] = (offset[i+1]) / PAGESIZE * PAGESIZE; // aligned with pages
+        if (offset[i+1] < offset[i]) {
+          offset[i+1] = offset[i];
+        }
+      }
+      remained_amount -= prefix_cost(offset[i+1]) - begin_cost;
+    }
+    delete [] block_cost;
+  }
+
   // load a directed graph and make it undirected
   void load_undirected_from_directed(std::string path, VertexId vertices) {
     double prep_time = 0;
@@ -359,26 +843,18 @@ public:
     }
     long bytes_to_read = edge_unit_size * read_edges;
     long read_offset = edge_unit_size * (edges / partitions * partition_id);
-    long read_bytes;
-    int fin = open(path.c_str(), O_RDONLY);
-    EdgeUnit<EdgeData> * read_edge_buffer = new EdgeUnit<EdgeData> [CHUNKSIZE];
+    // map this partition's slice once; every pass below scans it in place
+    MappedFile edge_file(path, read_offset, bytes_to_read);
+    EdgeUnit<EdgeData> * edge_slice = (EdgeUnit<EdgeData> *)edge_file.data;
 
     out_degree = alloc_interleaved_vertex_array<VertexId>();
     for (VertexId v_i=0;v_i<vertices;v_i++) {
       out_degree[v_i] = 0;
     }
-    assert(lseek(fin, read_offset, SEEK_SET)==read_offset);
-    read_bytes = 0;
-    while (read_bytes < bytes_to_read) {
-      long curr_read_bytes;
-      if (bytes_to_read - read_bytes > edge_unit_size * CHUNKSIZE) {
-        curr_read_bytes = read(fin, read_edge_buffer, edge_unit_size * CHUNKSIZE);
-      } else {
-        curr_read_bytes = read(fin, read_edge_buffer, bytes_to_read - read_bytes);
-      }
-      assert(curr_read_bytes>=0);
-      read_bytes += curr_read_bytes;
-      EdgeId curr_read_edges = curr_read_bytes / edge_unit_size;
+    for (EdgeId chunk_e_i=0;chunk_e_i<read_edges;chunk_e_i+=CHUNKSIZE) {
+      EdgeUnit<EdgeData> * read_edge_buffer = edge_slice + chunk_e_i;
+      EdgeId curr_read_edges = std::min(read_edges - chunk_e_i, (EdgeId)CHUNKSIZE);
+      edge_file.prefetch(edge_unit_size * (chunk_e_i + CHUNKSIZE), edge_unit_size * CHUNKSIZE);
       // #pragma omp parallel for
       for (EdgeId e_i=0;e_i<curr_read_edges;e_i++) {
         VertexId src = read_edge_buffer[e_i].src;
@@ -388,31 +864,17 @@ public:
       }
     }
     MPI_Allreduce(MPI_IN_PLACE, out_degree, vertices, vid_t, MPI_SUM, MPI_COMM_WORLD);
+    VertexId * global_in_degree = out_degree;
+
+    reorder_vertices(out_degree);
+    relabel_global_array(out_degree);
 
     // locality-aware chunking
+    auto vertex_cost = [&](VertexId v_i) {
+      return get_partition_vertex_cost(v_i, out_degree, global_in_degree) + alpha;
+    };
     partition_offset = new VertexId [partitions + 1];
-    partition_offset[0] = 0;
-    EdgeId remained_amount = edges * 2 + EdgeId(vertices) * alpha;
-    for (int i=0;i<partitions;i++) {
-      VertexId remained_partitions = partitions - i;
-      EdgeId expected_chunk_size = remained_amount / remained_partitions;
-      if (remained_partitions==1) {
-        partition_offset[i+1] = vertices;
-      } else {
-        EdgeId got_edges = 0;
-        for (VertexId v_i=partition_offset[i];v_i<vertices;v_i++) {
-          got_edges += out_degree[v_i] + alpha;
-          if (got_edges > expected_chunk_size) {
-            partition_offset[i+1] = v_i;
-            break;
-          }
-        }
-        partition_offset[i+1] = (partition_offset[i+1]) / PAGESIZE * PAGESIZE; // aligned with pages
-      }
-      for (VertexId v_i=partition_offset[i];v_i<partition_offset[i+1];v_i++) {
-        remained_amount -= out_degree[v_i] + alpha;
-      }
-    }
+    balanced_partition(0, vertices, partitions, vertex_cost, partition_offset);
     assert(partition_offset[partitions]==vertices);
     owned_vertices = partition_offset[partition_id+1] - partition_offset[partition_id];
     // check consistency of partition boundaries
@@ -441,37 +903,19 @@ public:
     {
       // NUMA-aware sub-chunking
       local_partition_offset = new VertexId [sockets + 1];
-      EdgeId part_out_edges = 0;
-      for (VertexId v_i=partition_offset[partition_id];v_i<partition_offset[partition_id+1];v_i++) {
-        part_out_edges += out_degree[v_i];
-      }
-      local_partition_offset[0] = partition_offset[partition_id];
-      EdgeId remained_amount = part_out_edges + EdgeId(owned_vertices) * alpha;
+      balanced_partition(partition_offset[partition_id], partition_offset[partition_id+1], sockets, vertex_cost, local_partition_offset);
+      #ifdef PRINT_DEBUG_MESSAGES
       for (int s_i=0;s_i<sockets;s_i++) {
-        VertexId remained_partitions = sockets - s_i;
-        EdgeId expected_chunk_size = remained_amount / remained_partitions;
-        if (remained_partitions==1) {
-          local_partition_offset[s_i+1] = partition_offset[partition_id+1];
-        } else {
-          EdgeId got_edges = 0;
-          for (VertexId v_i=local_partition_offset[s_i];v_i<partition_offset[partition_id+1];v_i++) {
-            got_edges += out_degree[v_i] + alpha;
-            if (got_edges > expected_chunk_size) {
-              local_partition_offset[s_i+1] = v_i;
-              break;
-            }
-          }
-          local_partition_offset[s_i+1] = (local_partition_offset[s_i+1]) / PAGESIZE * PAGESIZE; // aligned with pages
-        }
         EdgeId sub_part_out_edges = 0;
         for (VertexId v_i=local_partition_offset[s_i];v_i<local_partition_offset[s_i+1];v_i++) {
-          remained_amount -= out_degree[v_i] + alpha;
           sub_part_out_edges += out_degree[v_i];
         }
-        #ifdef PRINT_DEBUG_MESSAGES
         printf("|V'_%d_%d| = %u |E_%d| = %lu\n", partition_id, s_i, local_partition_offset[s_i+1] - local_partition_offset[s_i], partition_id, sub_part_out_edges);
-        #endif
       }
+      #endif
+    }
+    if (global_in_degree!=out_degree) {
+      numa_free(global_in_degree, sizeof(VertexId) * vertices);
     }
 
     VertexId * filtered_out_degree = alloc_vertex_array<VertexId>();
@@ -487,39 +931,38 @@ public:
     for (int i=0;i<partitions;i++) {
       send_buffer[i].resize(edge_unit_size * CHUNKSIZE);
     }
-    EdgeUnit<EdgeData> * recv_buffer = new EdgeUnit<EdgeData> [CHUNKSIZE];
 
-    // constructing symmetric edges
+    // constructing symmetric edges in a single shuffle:
+    // an edge whose endpoints share a partition is sent once and inserted in both directions there,
+    // other edges are sent forward to the owner of dst and reversed to the owner of src;
+    // received edges are kept so that the adjacency lists can be filled without a second shuffle
+    auto src_is_local = [&](VertexId src) {
+      return src >= partition_offset[partition_id] && src < partition_offset[partition_id+1];
+    };
     EdgeId recv_outgoing_edges = 0;
+    EdgeId local_adj_edges = 0;
+    for (VertexId v_i=partition_offset[partition_id];v_i<partition_offset[partition_id+1];v_i++) {
+      local_adj_edges += out_degree[v_i];
+    }
+    std::vector<EdgeUnit<EdgeData> > recv_edges_store;
+    recv_edges_store.reserve(local_adj_edges);
     outgoing_edges = new EdgeId [sockets];
     outgoing_adj_index = new EdgeId* [sockets];
     outgoing_adj_list = new AdjUnit<EdgeData>* [sockets];
     outgoing_adj_bitmap = new Bitmap * [sockets];
     for (int s_i=0;s_i<sockets;s_i++) {
-      outgoing_adj_bitmap[s_i] = new Bitmap (vertices);
+      outgoing_adj_bitmap[s_i] = new Bitmap (vertices, s_i);
       outgoing_adj_bitmap[s_i]->clear();
       outgoing_adj_index[s_i] = (EdgeId*)numa_alloc_onnode(sizeof(EdgeId) * (vertices+1), s_i);
+      #pragma omp parallel for
+      for (VertexId v_i=0;v_i<=vertices;v_i++) {
+        outgoing_adj_index[s_i][v_i] = 0;
+      }
     }
     {
       std::thread recv_thread_dst([&](){
-        int finished_count = 0;
-        MPI_Status recv_status;
-        while (finished_count < partitions) {
-          MPI_Probe(MPI_ANY_SOURCE, ShuffleGraph, MPI_COMM_WORLD, &recv_status);
-          int i = recv_status.MPI_SOURCE;
-          assert(recv_status.MPI_TAG == ShuffleGraph && i >=0 && i < partitions);
-          int recv_bytes;
-          MPI_Get_count(&recv_status, MPI_CHAR, &recv_bytes);
-          if (recv_bytes==1) {
-            finished_count += 1;
-            char c;
-            MPI_Recv(&c, 1, MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            continue;
-          }
-          assert(recv_bytes % edge_unit_size == 0);
-          int recv_edges = recv_bytes / edge_unit_size;
-          MPI_Recv(recv_buffer, edge_unit_size * recv_edges, MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-          // #pragma omp parallel for
+        recv_shuffled_edges([&](EdgeUnit<EdgeData> * recv_buffer, EdgeId recv_edges){
+          #pragma omp parallel for
           for (EdgeId e_i=0;e_i<recv_edges;e_i++) {
             VertexId src = recv_buffer[e_i].src;
             VertexId dst = recv_buffer[e_i].dst;
@@ -527,52 +970,46 @@ public:
             int dst_part = get_local_partition_id(dst);
             if (!outgoing_adj_bitmap[dst_part]->get_bit(src)) {
               outgoing_adj_bitmap[dst_part]->set_bit(src);
-              outgoing_adj_index[dst_part][src] = 0;
             }
             __sync_fetch_and_add(&outgoing_adj_index[dst_part][src], 1);
+            if (src_is_local(src)) {
+              int src_part = get_local_partition_id(src);
+              if (!outgoing_adj_bitmap[src_part]->get_bit(dst)) {
+                outgoing_adj_bitmap[src_part]->set_bit(dst);
+              }
+              __sync_fetch_and_add(&outgoing_adj_index[src_part][dst], 1);
+            }
           }
+          recv_edges_store.insert(recv_edges_store.end(), recv_buffer, recv_buffer + recv_edges);
           recv_outgoing_edges += recv_edges;
-        }
+        });
       });
       for (int i=0;i<partitions;i++) {
         buffered_edges[i] = 0;
       }
-      assert(lseek(fin, read_offset, SEEK_SET)==read_offset);
-      read_bytes = 0;
-      while (read_bytes < bytes_to_read) {
-        long curr_read_bytes;
-        if (bytes_to_read - read_bytes > edge_unit_size * CHUNKSIZE) {
-          curr_read_bytes = read(fin, read_edge_buffer, edge_unit_size * CHUNKSIZE);
-        } else {
-          curr_read_bytes = read(fin, read_edge_buffer, bytes_to_read - read_bytes);
-        }
-        assert(curr_read_bytes>=0);
-        read_bytes += curr_read_bytes;
-        EdgeId curr_read_edges = curr_read_bytes / edge_unit_size;
-        for (EdgeId e_i=0;e_i<curr_read_edges;e_i++) {
-          VertexId dst = read_edge_buffer[e_i].dst;
-          int i = get_partition_id(dst);
-          memcpy(send_buffer[i].data() + edge_unit_size * buffered_edges[i], &read_edge_buffer[e_i], edge_unit_size);
-          buffered_edges[i] += 1;
-          if (buffered_edges[i] == CHUNKSIZE) {
-            MPI_Send(send_buffer[i].data(), edge_unit_size * buffered_edges[i], MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD);
-            buffered_edges[i] = 0;
-          }
+      auto buffer_edge = [&](int i, EdgeUnit<EdgeData> & edge) {
+        memcpy(send_buffer[i].data() + edge_unit_size * buffered_edges[i], &edge, edge_unit_size);
+        buffered_edges[i] += 1;
+        if (buffered_edges[i] == CHUNKSIZE) {
+          MPI_Send(send_buffer[i].data(), edge_unit_size * buffered_edges[i], MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD);
+          buffered_edges[i] = 0;
         }
+      };
+      for (EdgeId chunk_e_i=0;chunk_e_i<read_edges;chunk_e_i+=CHUNKSIZE) {
+        EdgeUnit<EdgeData> * read_edge_buffer = edge_slice + chunk_e_i;
+        EdgeId curr_read_edges = std::min(read_edges - chunk_e_i, (EdgeId)CHUNKSIZE);
+        edge_file.prefetch(edge_unit_size * (chunk_e_i + CHUNKSIZE), edge_unit_size * CHUNKSIZE);
         for (EdgeId e_i=0;e_i<curr_read_edges;e_i++) {
-          // std::swap(read_edge_buffer[e_i].src, read_edge_buffer[e_i].dst);
-          VertexId tmp = read_edge_buffer[e_i].src;
-          read_edge_buffer[e_i].src = read_edge_buffer[e_i].dst;
-          read_edge_buffer[e_i].dst = tmp;
-        }
-        for (EdgeId e_i=0;e_i<curr_read_edges;e_i++) {
-          VertexId dst = read_edge_buffer[e_i].dst;
-          int i = get_partition_id(dst);
-          memcpy(send_buffer[i].data() + edge_unit_size * buffered_edges[i], &read_edge_buffer[e_i], edge_unit_size);
-          buffered_edges[i] += 1;
-          if (buffered_edges[i] == CHUNKSIZE) {
-            MPI_Send(send_buffer[i].data(), edge_unit_size * buffered_edges[i], MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD);
-            buffered_edges[i] = 0;
+          EdgeUnit<EdgeData> edge = read_edge_buffer[e_i];
+          relabel_edge(edge);
+          int dst_i = get_partition_id(edge.dst);
+          buffer_edge(dst_i, edge);
+          int src_i = get_partition_id(edge.src);
+          if (src_i != dst_i) {
+            VertexId src = edge.src;
+            edge.src = edge.dst;
+            edge.dst = src;
+            buffer_edge(src_i, edge);
           }
         }
       }
@@ -595,25 +1032,21 @@ public:
     for (int s_i=0;s_i<sockets;s_i++) {
       outgoing_edges[s_i] = 0;
       compressed_outgoing_adj_vertices[s_i] = 0;
-      for (VertexId v_i=0;v_i<vertices;v_i++) {
-        if (outgoing_adj_bitmap[s_i]->get_bit(v_i)) {
-          outgoing_edges[s_i] += outgoing_adj_index[s_i][v_i];
-          compressed_outgoing_adj_vertices[s_i] += 1;
-        }
-      }
+      outgoing_adj_bitmap[s_i]->for_each_bit(0, vertices, [&](VertexId v_i){
+        outgoing_edges[s_i] += outgoing_adj_index[s_i][v_i];
+        compressed_outgoing_adj_vertices[s_i] += 1;
+      });
       compressed_outgoing_adj_index[s_i] = (CompressedAdjIndexUnit*)numa_alloc_onnode( sizeof(CompressedAdjIndexUnit) * (compressed_outgoing_adj_vertices[s_i] + 1) , s_i );
       compressed_outgoing_adj_index[s_i][0].index = 0;
       EdgeId last_e_i = 0;
       compressed_outgoing_adj_vertices[s_i] = 0;
-      for (VertexId v_i=0;v_i<vertices;v_i++) {
-        if (outgoing_adj_bitmap[s_i]->get_bit(v_i)) {
-          outgoing_adj_index[s_i][v_i] = last_e_i + outgoing_adj_index[s_i][v_i];
-          last_e_i = outgoing_adj_index[s_i][v_i];
-          compressed_outgoing_adj_index[s_i][compressed_outgoing_adj_vertices[s_i]].vertex = v_i;
-          compressed_outgoing_adj_vertices[s_i] += 1;
-          compressed_outgoing_adj_index[s_i][compressed_outgoing_adj_vertices[s_i]].index = last_e_i;
-        }
-      }
+      outgoing_adj_bitmap[s_i]->for_each_bit(0, vertices, [&](VertexId v_i){
+        outgoing_adj_index[s_i][v_i] = last_e_i + outgoing_adj_index[s_i][v_i];
+        last_e_i = outgoing_adj_index[s_i][v_i];
+        compressed_outgoing_adj_index[s_i][compressed_outgoing_adj_vertices[s_i]].vertex = v_i;
+        compressed_outgoing_adj_vertices[s_i] += 1;
+        compressed_outgoing_adj_index[s_i][compressed_outgoing_adj_vertices[s_i]].index = last_e_i;
+      });
       for (VertexId p_v_i=0;p_v_i<compressed_outgoing_adj_vertices[s_i];p_v_i++) {
         VertexId v_i = compressed_outgoing_adj_index[s_i][p_v_i].vertex;
         outgoing_adj_index[s_i][v_i] = compressed_outgoing_adj_index[s_i][p_v_i].index;
@@ -624,92 +1057,26 @@ public:
       #endif
       outgoing_adj_list[s_i] = (AdjUnit<EdgeData>*)numa_alloc_onnode(unit_size * outgoing_edges[s_i], s_i);
     }
-    {
-      std::thread recv_thread_dst([&](){
-        int finished_count = 0;
-        MPI_Status recv_status;
-        while (finished_count < partitions) {
-          MPI_Probe(MPI_ANY_SOURCE, ShuffleGraph, MPI_COMM_WORLD, &recv_status);
-          int i = recv_status.MPI_SOURCE;
-          assert(recv_status.MPI_TAG == ShuffleGraph && i >=0 && i < partitions);
-          int recv_bytes;
-          MPI_Get_count(&recv_status, MPI_CHAR, &recv_bytes);
-          if (recv_bytes==1) {
-            finished_count += 1;
-            char c;
-            MPI_Recv(&c, 1, MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            continue;
-          }
-          assert(recv_bytes % edge_unit_size == 0);
-          int recv_edges = recv_bytes / edge_unit_size;
-          MPI_Recv(recv_buffer, edge_unit_size * recv_edges, MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-          #pragma omp parallel for
-          for (EdgeId e_i=0;e_i<recv_edges;e_i++) {
-            VertexId src = recv_buffer[e_i].src;
-            VertexId dst = recv_buffer[e_i].dst;
-            assert(dst >= partition_offset[partition_id] && dst < partition_offset[partition_id+1]);
-            int dst_part = get_local_partition_id(dst);
-            EdgeId pos = __sync_fetch_and_add(&outgoing_adj_index[dst_part][src], 1);
-            outgoing_adj_list[dst_part][pos].neighbour = dst;
-            if (!std::is_same<EdgeData, Empty>::value) {
-              outgoing_adj_list[dst_part][pos].edge_data = recv_buffer[e_i].edge_data;
-            }
-          }
-        }
-      });
-      for (int i=0;i<partitions;i++) {
-        buffered_edges[i] = 0;
-      }
-      assert(lseek(fin, read_offset, SEEK_SET)==read_offset);
-      read_bytes = 0;
-      while (read_bytes < bytes_to_read) {
-        long curr_read_bytes;
-        if (bytes_to_read - read_bytes > edge_unit_size * CHUNKSIZE) {
-          curr_read_bytes = read(fin, read_edge_buffer, edge_unit_size * CHUNKSIZE);
-        } else {
-          curr_read_bytes = read(fin, read_edge_buffer, bytes_to_read - read_bytes);
-        }
-        assert(curr_read_bytes>=0);
-        read_bytes += curr_read_bytes;
-        EdgeId curr_read_edges = curr_read_bytes / edge_unit_size;
-        for (EdgeId e_i=0;e_i<curr_read_edges;e_i++) {
-          VertexId dst = read_edge_buffer[e_i].dst;
-          int i = get_partition_id(dst);
-          memcpy(send_buffer[i].data() + edge_unit_size * buffered_edges[i], &read_edge_buffer[e_i], edge_unit_size);
-          buffered_edges[i] += 1;
-          if (buffered_edges[i] == CHUNKSIZE) {
-            MPI_Send(send_buffer[i].data(), edge_unit_size * buffered_edges[i], MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD);
-            buffered_edges[i] = 0;
-          }
-        }
-        for (EdgeId e_i=0;e_i<curr_read_edges;e_i++) {
-          // std::swap(read_edge_buffer[e_i].src, read_edge_buffer[e_i].dst);
-          VertexId tmp = read_edge_buffer[e_i].src;
-          read_edge_buffer[e_i].src = read_edge_buffer[e_i].dst;
-          read_edge_buffer[e_i].dst = tmp;
-        }
-        for (EdgeId e_i=0;e_i<curr_read_edges;e_i++) {
-          VertexId dst = read_edge_buffer[e_i].dst;
-          int i = get_partition_id(dst);
-          memcpy(send_buffer[i].data() + edge_unit_size * buffered_edges[i], &read_edge_buffer[e_i], edge_unit_size);
-          buffered_edges[i] += 1;
-          if (buffered_edges[i] == CHUNKSIZE) {
-            MPI_Send(send_buffer[i].data(), edge_unit_size * buffered_edges[i], MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD);
-            buffered_edges[i] = 0;
-          }
+    #pragma omp parallel for
+    for (EdgeId e_i=0;e_i<recv_outgoing_edges;e_i++) {
+      VertexId src = recv_edges_store[e_i].src;
+      VertexId dst = recv_edges_store[e_i].dst;
+      int dst_part = get_local_partition_id(dst);
+      EdgeId pos = __sync_fetch_and_add(&outgoing_adj_index[dst_part][src], 1);
+      outgoing_adj_list[dst_part][pos].neighbour = dst;
+      if (!std::is_same<EdgeData, Empty>::value) {
+        outgoing_adj_list[dst_part][pos].edge_data = recv_edges_store[e_i].edge_data;
+      }
+      if (src_is_local(src)) {
+        int src_part = get_local_partition_id(src);
+        pos = __sync_fetch_and_add(&outgoing_adj_index[src_part][dst], 1);
+        outgoing_adj_list[src_part][pos].neighbour = src;
+        if (!std::is_same<EdgeData, Empty>::value) {
+          outgoing_adj_list[src_part][pos].edge_data = recv_edges_store[e_i].edge_data;
         }
       }
-      for (int i=0;i<partitions;i++) {
-        if (buffered_edges[i]==0) continue;
-        MPI_Send(send_buffer[i].data(), edge_unit_size * buffered_edges[i], MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD);
-        buffered_edges[i] = 0;
-      }
-      for (int i=0;i<partitions;i++) {
-        char c = 0;
-        MPI_Send(&c, 1, MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD);
-      }
-      recv_thread_dst.join();
     }
+    std::vector<EdgeUnit<EdgeData> >().swap(recv_edges_store);
     for (int s_i=0;s_i<sockets;s_i++) {
       for (VertexId p_v_i=0;p_v_i<compressed_outgoing_adj_vertices[s_i];p_v_i++) {
         VertexId v_i = compressed_outgoing_adj_index[s_i][p_v_i].vertex;
@@ -729,9 +1096,6 @@ public:
 
     delete [] buffered_edges;
     delete [] send_buffer;
-    delete [] read_edge_buffer;
-    delete [] recv_buffer;
-    close(fin);
 
     tune_chunks();
     tuned_chunks_sparse = tuned_chunks_dense;
@@ -745,8 +1109,9 @@ public:
     #endif
   }
 
-  // transpose the graph
+  // transpose the graph; symmetric graphs share one adjacency structure for both directions
   void transpose() {
+    if (symmetric) return;
     std::swap(out_degree, in_degree);
     std::swap(outgoing_edges, incoming_edges);
     std::swap(outgoing_adj_index, incoming_adj_index);
@@ -755,21 +1120,401 @@ public:
     std::swap(tuned_chunks_dense, tuned_chunks_sparse);
     std::swap(compressed_outgoing_adj_vertices, compressed_incoming_adj_vertices);
     std::swap(compressed_outgoing_adj_index, compressed_incoming_adj_index);
+    std::swap(outgoing_adj_stream, incoming_adj_stream);
   }
 
-  // load a directed graph from path
-  void load_directed(std::string path, VertexId vertices) {
-    double prep_time = 0;
-    prep_time -= MPI_Wtime();
-
-    symmetric = false;
-
-    MPI_Datatype vid_t = get_mpi_data_type<VertexId>();
-
-    this->vertices = vertices;
-    long total_bytes = file_size(path.c_str());
-    this->edges = total_bytes / edge_unit_size;
-    #ifdef PRINT_DEBUG_MESSAGES
+  // encode one direction of the adjacency lists: neighbours are sorted, then stored as
+  // zigzag varint deltas (the first one relative to the source vertex) each followed by its edge data
+  unsigned char ** encode_adjacency(EdgeId * edges, EdgeId ** adj_index, AdjUnit<EdgeData> ** adj_list, VertexId * compressed_adj_vertices, CompressedAdjIndexUnit ** compressed_adj_index) {
+    unsigned char ** adj_stream = new unsigned char * [sockets];
+    for (int s_i=0;s_i<sockets;s_i++) {
+      VertexId compressed_vertices = compressed_adj_vertices[s_i];
+      CompressedAdjIndexUnit * compressed_index = compressed_adj_index[s_i];
+      EdgeId * stream_offset = new EdgeId [compressed_vertices + 1];
+      stream_offset[0] = 0;
+      #pragma omp parallel for schedule(dynamic, 64)
+      for (VertexId p_v_i=0;p_v_i<compressed_vertices;p_v_i++) {
+        VertexId v_i = compressed_index[p_v_i].vertex;
+        AdjUnit<EdgeData> * begin = adj_list[s_i] + compressed_index[p_v_i].index;
+        AdjUnit<EdgeData> * end = adj_list[s_i] + compressed_index[p_v_i+1].index;
+        std::sort(begin, end, [](const AdjUnit<EdgeData> & a, const AdjUnit<EdgeData> & b){
+          return a.neighbour < b.neighbour;
+        });
+        EdgeId bytes = varint_size(zigzag_encode((int64_t)begin->neighbour - v_i));
+        for (AdjUnit<EdgeData> * ptr=begin+1;ptr<end;ptr++) {
+          bytes += varint_size(ptr->neighbour - (ptr-1)->neighbour);
+        }
+        stream_offset[p_v_i+1] = bytes + edge_data_size * (end - begin);
+      }
+      for (VertexId p_v_i=0;p_v_i<compressed_vertices;p_v_i++) {
+        stream_offset[p_v_i+1] += stream_offset[p_v_i];
+      }
+      EdgeId stream_bytes = stream_offset[compressed_vertices];
+      adj_stream[s_i] = (unsigned char *)numa_alloc_onnode(stream_bytes + 1, s_i);
+      #pragma omp parallel for schedule(dynamic, 64)
+      for (VertexId p_v_i=0;p_v_i<compressed_vertices;p_v_i++) {
+        VertexId v_i = compressed_index[p_v_i].vertex;
+        AdjUnit<EdgeData> * begin = adj_list[s_i] + compressed_index[p_v_i].index;
+        AdjUnit<EdgeData> * end = adj_list[s_i] + compressed_index[p_v_i+1].index;
+        unsigned char * out = adj_stream[s_i] + stream_offset[p_v_i];
+        VertexId prev = v_i;
+        for (AdjUnit<EdgeData> * ptr=begin;ptr<end;ptr++) {
+          out = encode_varint(out, ptr==begin ? zigzag_encode((int64_t)ptr->neighbour - v_i) : ptr->neighbour - prev);
+          prev = ptr->neighbour;
+          if (edge_data_size > 0) {
+            memcpy(out, &ptr->edge_data, edge_data_size);
+            out += edge_data_size;
+          }
+        }
+        assert(out==adj_stream[s_i] + stream_offset[p_v_i+1]);
+      }
+      #pragma omp parallel for
+      for (VertexId p_v_i=0;p_v_i<compressed_vertices;p_v_i++) {
+        VertexId v_i = compressed_index[p_v_i].vertex;
+        adj_index[s_i][v_i] = stream_offset[p_v_i];
+        adj_index[s_i][v_i+1] = stream_offset[p_v_i+1];
+      }
+      for (VertexId p_v_i=0;p_v_i<=compressed_vertices;p_v_i++) {
+        compressed_index[p_v_i].index = stream_offset[p_v_i];
+      }
+      #ifdef PRINT_DEBUG_MESSAGES
+      printf("part(%d) socket(%d) adjacency %lu -> %lu bytes\n", partition_id, s_i, unit_size * edges[s_i], stream_bytes);
+      #endif
+      numa_free(adj_list[s_i], unit_size * edges[s_i]);
+      adj_list[s_i] = nullptr;
+      delete [] stream_offset;
+    }
+    return adj_stream;
+  }
+
+  // replace the adjacency lists with compressed byte streams; process_edges decodes them on the fly
+  void encode_adjacency() {
+    assert(!encoded_adj);
+    outgoing_adj_stream = encode_adjacency(outgoing_edges, outgoing_adj_index, outgoing_adj_list, compressed_outgoing_adj_vertices, compressed_outgoing_adj_index);
+    if (symmetric) {
+      incoming_adj_stream = outgoing_adj_stream;
+    } else {
+      incoming_adj_stream = encode_adjacency(incoming_edges, incoming_adj_index, incoming_adj_list, compressed_incoming_adj_vertices, compressed_incoming_adj_index);
+    }
+    encoded_adj = true;
+  }
+
+  // adjacency list of v_i spanning [begin, end) in adj_list[s_i] (or bytes of adj_stream[s_i] once encoded);
+  // adj_stream is only allocated by encode_adjacency, so it is not touched unless encoded_adj is set;
+  // encoded lists are decoded into a per-thread buffer that stays valid until the next call
+  inline VertexAdjList<EdgeData> get_adj_list(AdjUnit<EdgeData> ** adj_list, unsigned char ** adj_stream, int s_i, VertexId v_i, EdgeId begin, EdgeId end) {
+    if (!encoded_adj) {
+      return VertexAdjList<EdgeData>(adj_list[s_i] + begin, adj_list[s_i] + end);
+    }
+    static thread_local std::vector<AdjUnit<EdgeData> > decode_buffer;
+    size_t max_units = (end - begin) / (1 + edge_data_size);
+    if (decode_buffer.size() < max_units) {
+      decode_buffer.resize(max_units);
+    }
+    AdjUnit<EdgeData> * out = decode_buffer.data();
+    const unsigned char * ptr = adj_stream[s_i] + begin;
+    const unsigned char * ptr_end = adj_stream[s_i] + end;
+    if (ptr < ptr_end) {
+      uint64_t delta;
+      ptr = decode_varint(ptr, delta);
+      VertexId neighbour = (VertexId)((int64_t)v_i + zigzag_decode(delta));
+      while (true) {
+        out->neighbour = neighbour;
+        if (edge_data_size > 0) {
+          memcpy(&out->edge_data, ptr, edge_data_size);
+          ptr += edge_data_size;
+        }
+        out++;
+        if (ptr >= ptr_end) break;
+        ptr = decode_varint(ptr, delta);
+        neighbour += (VertexId)delta;
+      }
+    }
+    return VertexAdjList<EdgeData>(decode_buffer.data(), out);
+  }
+
+  // receive shuffled edges until every partition has finished sending;
+  // batch k is handed to process while batch k+1 is still being received
+  void recv_shuffled_edges(std::function<void(EdgeUnit<EdgeData> *, EdgeId)> process) {
+    EdgeUnit<EdgeData> * recv_buffer[SHUFFLE_BUFFERS];
+    EdgeId recv_buffer_edges[SHUFFLE_BUFFERS];
+    for (int b_i=0;b_i<SHUFFLE_BUFFERS;b_i++) {
+      recv_buffer[b_i] = new EdgeUnit<EdgeData> [CHUNKSIZE];
+    }
+    int received_batches = 0;
+    int processed_batches = 0;
+    bool finished = false;
+    std::mutex batch_mutex;
+    std::condition_variable batch_cond;
+
+    std::thread recv_thread([&](){
+      int finished_count = 0;
+      MPI_Status recv_status;
+      while (finished_count < partitions) {
+        MPI_Probe(MPI_ANY_SOURCE, ShuffleGraph, MPI_COMM_WORLD, &recv_status);
+        int i = recv_status.MPI_SOURCE;
+        assert(recv_status.MPI_TAG == ShuffleGraph && i >=0 && i < partitions);
+        int recv_bytes;
+        MPI_Get_count(&recv_status, MPI_CHAR, &recv_bytes);
+        if (recv_bytes==1) {
+          finished_count += 1;
+          char c;
+          MPI_Recv(&c, 1, MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+          continue;
+        }
+        assert(recv_bytes % edge_unit_size == 0);
+        {
+          std::unique_lock<std::mutex> lock(batch_mutex);
+          batch_cond.wait(lock, [&](){ return received_batches - processed_batches < SHUFFLE_BUFFERS; });
+        }
+        int b_i = received_batches % SHUFFLE_BUFFERS;
+        MPI_Recv(recv_buffer[b_i], recv_bytes, MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        recv_buffer_edges[b_i] = recv_bytes / edge_unit_size;
+        {
+          std::lock_guard<std::mutex> lock(batch_mutex);
+          received_batches += 1;
+        }
+        batch_cond.notify_all();
+      }
+      {
+        std::lock_guard<std::mutex> lock(batch_mutex);
+        finished = true;
+      }
+      batch_cond.notify_all();
+    });
+    while (true) {
+      int b_i;
+      {
+        std::unique_lock<std::mutex> lock(batch_mutex);
+        batch_cond.wait(lock, [&](){ return processed_batches < received_batches || finished; });
+        if (processed_batches==received_batches) break;
+        b_i = processed_batches % SHUFFLE_BUFFERS;
+      }
+      process(recv_buffer[b_i], recv_buffer_edges[b_i]);
+      {
+        std::lock_guard<std::mutex> lock(batch_mutex);
+        processed_batches += 1;
+      }
+      batch_cond.notify_all();
+    }
+    recv_thread.join();
+    for (int b_i=0;b_i<SHUFFLE_BUFFERS;b_i++) {
+      delete [] recv_buffer[b_i];
+    }
+    // a partition that is done may start sending the next pass, whose messages carry the same tag;
+    // keep them away from receivers that are still waiting for this pass to finish
+    MPI_Barrier(MPI_COMM_WORLD);
+  }
+
+  // path of this partition's snapshot file
+  std::string snapshot_path(std::string path) {
+    return path + "." + std::to_string(partition_id);
+  }
+
+  // save the partitioned graph so that load_snapshot can skip the shuffle
+  void save_snapshot(std::string path) {
+    assert(!encoded_adj); // snapshots hold the plain lists; encode after loading instead
+    double save_time = 0;
+    save_time -= MPI_Wtime();
+
+    FILE * fout = fopen(snapshot_path(path).c_str(), "wb");
+    assert(fout!=NULL);
+    auto write_array = [&](const void * array, size_t bytes) {
+      assert(fwrite(array, 1, bytes, fout)==bytes);
+    };
+    auto write_adjacency = [&](EdgeId * edges, Bitmap ** adj_bitmap, EdgeId ** adj_index, AdjUnit<EdgeData> ** adj_list, VertexId * compressed_adj_vertices, CompressedAdjIndexUnit ** compressed_adj_index) {
+      for (int s_i=0;s_i<sockets;s_i++) {
+        write_array(&edges[s_i], sizeof(EdgeId));
+        write_array(adj_bitmap[s_i]->data, sizeof(unsigned long) * (WORD_OFFSET(vertices) + 1));
+        write_array(adj_index[s_i], sizeof(EdgeId) * (vertices + 1));
+        write_array(adj_list[s_i], unit_size * edges[s_i]);
+        write_array(&compressed_adj_vertices[s_i], sizeof(VertexId));
+        write_array(compressed_adj_index[s_i], sizeof(CompressedAdjIndexUnit) * (compressed_adj_vertices[s_i] + 1));
+      }
+    };
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "GEMINI", 6);
+    header.version = SNAPSHOT_VERSION;
+    header.partitions = partitions;
+    header.partition_id = partition_id;
+    header.sockets = sockets;
+    header.threads = threads;
+    header.symmetric = symmetric;
+    header.vertex_order = vertex_order;
+    header.edge_unit_size = edge_unit_size;
+    header.vertices = vertices;
+    header.edges = edges;
+    write_array(&header, sizeof(header));
+    write_array(partition_offset, sizeof(VertexId) * (partitions + 1));
+    write_array(local_partition_offset, sizeof(VertexId) * (sockets + 1));
+    if (reorder_forward!=nullptr) {
+      write_array(reorder_forward, sizeof(VertexId) * vertices);
+    }
+    write_array(out_degree + partition_offset[partition_id], sizeof(VertexId) * owned_vertices);
+    write_adjacency(outgoing_edges, outgoing_adj_bitmap, outgoing_adj_index, outgoing_adj_list, compressed_outgoing_adj_vertices, compressed_outgoing_adj_index);
+    for (int i=0;i<partitions;i++) {
+      write_array(tuned_chunks_dense[i], sizeof(ThreadState) * threads);
+    }
+    if (!symmetric) {
+      write_array(in_degree + partition_offset[partition_id], sizeof(VertexId) * owned_vertices);
+      write_adjacency(incoming_edges, incoming_adj_bitmap, incoming_adj_index, incoming_adj_list, compressed_incoming_adj_vertices, compressed_incoming_adj_index);
+      for (int i=0;i<partitions;i++) {
+        write_array(tuned_chunks_sparse[i], sizeof(ThreadState) * threads);
+      }
+    }
+    assert(fclose(fout)==0);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    save_time += MPI_Wtime();
+    #ifdef PRINT_DEBUG_MESSAGES
+    if (partition_id==0) {
+      printf("saving snapshot cost: %.2lf (s)\n", save_time);
+    }
+    #endif
+  }
+
+  // load a graph saved by save_snapshot; returns false on every partition if any snapshot is missing or does not match
+  bool load_snapshot(std::string path, VertexId vertices, bool symmetric) {
+    double prep_time = 0;
+    prep_time -= MPI_Wtime();
+
+    std::string filename = snapshot_path(path);
+    int matched = file_exists(filename) && file_size(filename) >= (long)sizeof(SnapshotHeader);
+    if (matched) {
+      SnapshotHeader header;
+      FILE * fin = fopen(filename.c_str(), "rb");
+      assert(fin!=NULL);
+      assert(fread(&header, 1, sizeof(header), fin)==sizeof(header));
+      assert(fclose(fin)==0);
+      matched = memcmp(header.magic, "GEMINI", 6)==0
+        && header.version==SNAPSHOT_VERSION
+        && header.partitions==partitions
+        && header.partition_id==partition_id
+        && header.sockets==sockets
+        && header.symmetric==symmetric
+        && header.vertex_order==vertex_order
+        && header.edge_unit_size==edge_unit_size
+        && header.vertices==vertices;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &matched, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    if (!matched) {
+      return false;
+    }
+
+    MappedFile snapshot(filename, 0, file_size(filename));
+    char * cursor = snapshot.data;
+    auto read_array = [&](void * array, size_t bytes) {
+      memcpy(array, cursor, bytes);
+      cursor += bytes;
+    };
+    auto read_adjacency = [&](EdgeId * & edges, Bitmap ** & adj_bitmap, EdgeId ** & adj_index, AdjUnit<EdgeData> ** & adj_list, VertexId * & compressed_adj_vertices, CompressedAdjIndexUnit ** & compressed_adj_index) {
+      edges = new EdgeId [sockets];
+      adj_bitmap = new Bitmap * [sockets];
+      adj_index = new EdgeId* [sockets];
+      adj_list = new AdjUnit<EdgeData>* [sockets];
+      compressed_adj_vertices = new VertexId [sockets];
+      compressed_adj_index = new CompressedAdjIndexUnit * [sockets];
+      for (int s_i=0;s_i<sockets;s_i++) {
+        read_array(&edges[s_i], sizeof(EdgeId));
+        adj_bitmap[s_i] = new Bitmap (vertices, s_i);
+        read_array(adj_bitmap[s_i]->data, sizeof(unsigned long) * (WORD_OFFSET(vertices) + 1));
+        adj_index[s_i] = (EdgeId*)numa_alloc_onnode(sizeof(EdgeId) * (vertices+1), s_i);
+        read_array(adj_index[s_i], sizeof(EdgeId) * (vertices + 1));
+        adj_list[s_i] = (AdjUnit<EdgeData>*)numa_alloc_onnode(unit_size * edges[s_i], s_i);
+        read_array(adj_list[s_i], unit_size * edges[s_i]);
+        read_array(&compressed_adj_vertices[s_i], sizeof(VertexId));
+        compressed_adj_index[s_i] = (CompressedAdjIndexUnit*)numa_alloc_onnode(sizeof(CompressedAdjIndexUnit) * (compressed_adj_vertices[s_i] + 1), s_i);
+        read_array(compressed_adj_index[s_i], sizeof(CompressedAdjIndexUnit) * (compressed_adj_vertices[s_i] + 1));
+      }
+    };
+    auto read_chunks = [&](ThreadState ** & tuned_chunks, int saved_threads) {
+      if (saved_threads!=threads) {
+        // tuned for another thread count; re-tuned below
+        cursor += sizeof(ThreadState) * saved_threads * partitions;
+        return;
+      }
+      tuned_chunks = new ThreadState * [partitions];
+      for (int i=0;i<partitions;i++) {
+        tuned_chunks[i] = new ThreadState [threads];
+        read_array(tuned_chunks[i], sizeof(ThreadState) * threads);
+      }
+    };
+
+    SnapshotHeader header;
+    read_array(&header, sizeof(header));
+    this->symmetric = symmetric;
+    this->vertices = vertices;
+    this->edges = header.edges;
+    partition_offset = new VertexId [partitions + 1];
+    read_array(partition_offset, sizeof(VertexId) * (partitions + 1));
+    local_partition_offset = new VertexId [sockets + 1];
+    read_array(local_partition_offset, sizeof(VertexId) * (sockets + 1));
+    if (vertex_order!=OriginalOrder) {
+      reorder_forward = alloc_interleaved_vertex_array<VertexId>();
+      read_array(reorder_forward, sizeof(VertexId) * vertices);
+      reorder_backward = alloc_interleaved_vertex_array<VertexId>();
+      #pragma omp parallel for
+      for (VertexId v_i=0;v_i<vertices;v_i++) {
+        reorder_backward[reorder_forward[v_i]] = v_i;
+      }
+    }
+    owned_vertices = partition_offset[partition_id+1] - partition_offset[partition_id];
+    out_degree = alloc_vertex_array<VertexId>();
+    read_array(out_degree + partition_offset[partition_id], sizeof(VertexId) * owned_vertices);
+    read_adjacency(outgoing_edges, outgoing_adj_bitmap, outgoing_adj_index, outgoing_adj_list, compressed_outgoing_adj_vertices, compressed_outgoing_adj_index);
+    read_chunks(tuned_chunks_dense, header.threads);
+    if (symmetric) {
+      in_degree = out_degree;
+      incoming_edges = outgoing_edges;
+      incoming_adj_index = outgoing_adj_index;
+      incoming_adj_list = outgoing_adj_list;
+      incoming_adj_bitmap = outgoing_adj_bitmap;
+      compressed_incoming_adj_vertices = compressed_outgoing_adj_vertices;
+      compressed_incoming_adj_index = compressed_outgoing_adj_index;
+      if (header.threads!=threads) {
+        tune_chunks();
+      }
+      tuned_chunks_sparse = tuned_chunks_dense;
+    } else {
+      in_degree = alloc_vertex_array<VertexId>();
+      read_array(in_degree + partition_offset[partition_id], sizeof(VertexId) * owned_vertices);
+      read_adjacency(incoming_edges, incoming_adj_bitmap, incoming_adj_index, incoming_adj_list, compressed_incoming_adj_vertices, compressed_incoming_adj_index);
+      read_chunks(tuned_chunks_sparse, header.threads);
+      if (header.threads!=threads) {
+        transpose();
+        tune_chunks();
+        transpose();
+        tune_chunks();
+      }
+    }
+    assert(cursor==snapshot.data + snapshot.length);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    prep_time += MPI_Wtime();
+    #ifdef PRINT_DEBUG_MESSAGES
+    if (partition_id==0) {
+      printf("|V| = %u, |E| = %lu\n", vertices, edges);
+      printf("loading snapshot cost: %.2lf (s)\n", prep_time);
+    }
+    #endif
+    return true;
+  }
+
+  // load a directed graph from path
+  void load_directed(std::string path, VertexId vertices) {
+    double prep_time = 0;
+    prep_time -= MPI_Wtime();
+
+    symmetric = false;
+
+    MPI_Datatype vid_t = get_mpi_data_type<VertexId>();
+
+    this->vertices = vertices;
+    long total_bytes = file_size(path.c_str());
+    this->edges = total_bytes / edge_unit_size;
+    #ifdef PRINT_DEBUG_MESSAGES
     if (partition_id==0) {
       printf("|V| = %u, |E| = %lu\n", vertices, edges);
     }
@@ -781,59 +1526,53 @@ public:
     }
     long bytes_to_read = edge_unit_size * read_edges;
     long read_offset = edge_unit_size * (edges / partitions * partition_id);
-    long read_bytes;
-    int fin = open(path.c_str(), O_RDONLY);
-    EdgeUnit<EdgeData> * read_edge_buffer = new EdgeUnit<EdgeData> [CHUNKSIZE];
+    // map this partition's slice once; every pass below scans it in place
+    MappedFile edge_file(path, read_offset, bytes_to_read);
+    EdgeUnit<EdgeData> * edge_slice = (EdgeUnit<EdgeData> *)edge_file.data;
 
     out_degree = alloc_interleaved_vertex_array<VertexId>();
     for (VertexId v_i=0;v_i<vertices;v_i++) {
       out_degree[v_i] = 0;
     }
-    assert(lseek(fin, read_offset, SEEK_SET)==read_offset);
-    read_bytes = 0;
-    while (read_bytes < bytes_to_read) {
-      long curr_read_bytes;
-      if (bytes_to_read - read_bytes > edge_unit_size * CHUNKSIZE) {
-        curr_read_bytes = read(fin, read_edge_buffer, edge_unit_size * CHUNKSIZE);
-      } else {
-        curr_read_bytes = read(fin, read_edge_buffer, bytes_to_read - read_bytes);
+    // global in-degrees are only counted if the partitioning cost model needs them
+    VertexId * global_in_degree = nullptr;
+    if (partition_cost==InDegreeCost || partition_cost==MixedDegreeCost) {
+      global_in_degree = alloc_interleaved_vertex_array<VertexId>();
+      for (VertexId v_i=0;v_i<vertices;v_i++) {
+        global_in_degree[v_i] = 0;
       }
-      assert(curr_read_bytes>=0);
-      read_bytes += curr_read_bytes;
-      EdgeId curr_read_edges = curr_read_bytes / edge_unit_size;
+    }
+    for (EdgeId chunk_e_i=0;chunk_e_i<read_edges;chunk_e_i+=CHUNKSIZE) {
+      EdgeUnit<EdgeData> * read_edge_buffer = edge_slice + chunk_e_i;
+      EdgeId curr_read_edges = std::min(read_edges - chunk_e_i, (EdgeId)CHUNKSIZE);
+      edge_file.prefetch(edge_unit_size * (chunk_e_i + CHUNKSIZE), edge_unit_size * CHUNKSIZE);
       #pragma omp parallel for
       for (EdgeId e_i=0;e_i<curr_read_edges;e_i++) {
         VertexId src = read_edge_buffer[e_i].src;
         VertexId dst = read_edge_buffer[e_i].dst;
         __sync_fetch_and_add(&out_degree[src], 1);
+        if (global_in_degree!=nullptr) {
+          __sync_fetch_and_add(&global_in_degree[dst], 1);
+        }
       }
     }
     MPI_Allreduce(MPI_IN_PLACE, out_degree, vertices, vid_t, MPI_SUM, MPI_COMM_WORLD);
+    if (global_in_degree!=nullptr) {
+      MPI_Allreduce(MPI_IN_PLACE, global_in_degree, vertices, vid_t, MPI_SUM, MPI_COMM_WORLD);
+    }
+
+    reorder_vertices(out_degree);
+    relabel_global_array(out_degree);
+    if (global_in_degree!=nullptr) {
+      relabel_global_array(global_in_degree);
+    }
 
     // locality-aware chunking
+    auto vertex_cost = [&](VertexId v_i) {
+      return get_partition_vertex_cost(v_i, out_degree, global_in_degree) + alpha;
+    };
     partition_offset = new VertexId [partitions + 1];
-    partition_offset[0] = 0;
-    EdgeId remained_amount = edges + EdgeId(vertices) * alpha;
-    for (int i=0;i<partitions;i++) {
-      VertexId remained_partitions = partitions - i;
-      EdgeId expected_chunk_size = remained_amount / remained_partitions;
-      if (remained_partitions==1) {
-        partition_offset[i+1] = vertices;
-      } else {
-        EdgeId got_edges = 0;
-        for (VertexId v_i=partition_offset[i];v_i<vertices;v_i++) {
-          got_edges += out_degree[v_i] + alpha;
-          if (got_edges > expected_chunk_size) {
-            partition_offset[i+1] = v_i;
-            break;
-          }
-        }
-        partition_offset[i+1] = (partition_offset[i+1]) / PAGESIZE * PAGESIZE; // aligned with pages
-      }
-      for (VertexId v_i=partition_offset[i];v_i<partition_offset[i+1];v_i++) {
-        remained_amount -= out_degree[v_i] + alpha;
-      }
-    }
+    balanced_partition(0, vertices, partitions, vertex_cost, partition_offset);
     assert(partition_offset[partitions]==vertices);
     owned_vertices = partition_offset[partition_id+1] - partition_offset[partition_id];
     // check consistency of partition boundaries
@@ -861,37 +1600,19 @@ public:
     {
       // NUMA-aware sub-chunking
       local_partition_offset = new VertexId [sockets + 1];
-      EdgeId part_out_edges = 0;
-      for (VertexId v_i=partition_offset[partition_id];v_i<partition_offset[partition_id+1];v_i++) {
-        part_out_edges += out_degree[v_i];
-      }
-      local_partition_offset[0] = partition_offset[partition_id];
-      EdgeId remained_amount = part_out_edges + EdgeId(owned_vertices) * alpha;
+      balanced_partition(partition_offset[partition_id], partition_offset[partition_id+1], sockets, vertex_cost, local_partition_offset);
+      #ifdef PRINT_DEBUG_MESSAGES
       for (int s_i=0;s_i<sockets;s_i++) {
-        VertexId remained_partitions = sockets - s_i;
-        EdgeId expected_chunk_size = remained_amount / remained_partitions;
-        if (remained_partitions==1) {
-          local_partition_offset[s_i+1] = partition_offset[partition_id+1];
-        } else {
-          EdgeId got_edges = 0;
-          for (VertexId v_i=local_partition_offset[s_i];v_i<partition_offset[partition_id+1];v_i++) {
-            got_edges += out_degree[v_i] + alpha;
-            if (got_edges > expected_chunk_size) {
-              local_partition_offset[s_i+1] = v_i;
-              break;
-            }
-          }
-          local_partition_offset[s_i+1] = (local_partition_offset[s_i+1]) / PAGESIZE * PAGESIZE; // aligned with pages
-        }
         EdgeId sub_part_out_edges = 0;
         for (VertexId v_i=local_partition_offset[s_i];v_i<local_partition_offset[s_i+1];v_i++) {
-          remained_amount -= out_degree[v_i] + alpha;
           sub_part_out_edges += out_degree[v_i];
         }
-        #ifdef PRINT_DEBUG_MESSAGES
         printf("|V'_%d_%d| = %u |E^dense_%d_%d| = %lu\n", partition_id, s_i, local_partition_offset[s_i+1] - local_partition_offset[s_i], partition_id, s_i, sub_part_out_edges);
-        #endif
       }
+      #endif
+    }
+    if (global_in_degree!=nullptr) {
+      numa_free(global_in_degree, sizeof(VertexId) * vertices);
     }
 
     VertexId * filtered_out_degree = alloc_vertex_array<VertexId>();
@@ -910,7 +1631,6 @@ public:
     for (int i=0;i<partitions;i++) {
       send_buffer[i].resize(edge_unit_size * CHUNKSIZE);
     }
-    EdgeUnit<EdgeData> * recv_buffer = new EdgeUnit<EdgeData> [CHUNKSIZE];
 
     EdgeId recv_outgoing_edges = 0;
     outgoing_edges = new EdgeId [sockets];
@@ -918,30 +1638,18 @@ public:
     outgoing_adj_list = new AdjUnit<EdgeData>* [sockets];
     outgoing_adj_bitmap = new Bitmap * [sockets];
     for (int s_i=0;s_i<sockets;s_i++) {
-      outgoing_adj_bitmap[s_i] = new Bitmap (vertices);
+      outgoing_adj_bitmap[s_i] = new Bitmap (vertices, s_i);
       outgoing_adj_bitmap[s_i]->clear();
       outgoing_adj_index[s_i] = (EdgeId*)numa_alloc_onnode(sizeof(EdgeId) * (vertices+1), s_i);
+      #pragma omp parallel for
+      for (VertexId v_i=0;v_i<=vertices;v_i++) {
+        outgoing_adj_index[s_i][v_i] = 0;
+      }
     }
     {
       std::thread recv_thread_dst([&](){
-        int finished_count = 0;
-        MPI_Status recv_status;
-        while (finished_count < partitions) {
-          MPI_Probe(MPI_ANY_SOURCE, ShuffleGraph, MPI_COMM_WORLD, &recv_status);
-          int i = recv_status.MPI_SOURCE;
-          assert(recv_status.MPI_TAG == ShuffleGraph && i >=0 && i < partitions);
-          int recv_bytes;
-          MPI_Get_count(&recv_status, MPI_CHAR, &recv_bytes);
-          if (recv_bytes==1) {
-            finished_count += 1;
-            char c;
-            MPI_Recv(&c, 1, MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            continue;
-          }
-          assert(recv_bytes % edge_unit_size == 0);
-          int recv_edges = recv_bytes / edge_unit_size;
-          MPI_Recv(recv_buffer, edge_unit_size * recv_edges, MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-          // #pragma omp parallel for
+        recv_shuffled_edges([&](EdgeUnit<EdgeData> * recv_buffer, EdgeId recv_edges){
+          #pragma omp parallel for
           for (EdgeId e_i=0;e_i<recv_edges;e_i++) {
             VertexId src = recv_buffer[e_i].src;
             VertexId dst = recv_buffer[e_i].dst;
@@ -949,33 +1657,25 @@ public:
             int dst_part = get_local_partition_id(dst);
             if (!outgoing_adj_bitmap[dst_part]->get_bit(src)) {
               outgoing_adj_bitmap[dst_part]->set_bit(src);
-              outgoing_adj_index[dst_part][src] = 0;
             }
             __sync_fetch_and_add(&outgoing_adj_index[dst_part][src], 1);
             __sync_fetch_and_add(&in_degree[dst], 1);
           }
           recv_outgoing_edges += recv_edges;
-        }
+        });
       });
       for (int i=0;i<partitions;i++) {
         buffered_edges[i] = 0;
       }
-      assert(lseek(fin, read_offset, SEEK_SET)==read_offset);
-      read_bytes = 0;
-      while (read_bytes < bytes_to_read) {
-        long curr_read_bytes;
-        if (bytes_to_read - read_bytes > edge_unit_size * CHUNKSIZE) {
-          curr_read_bytes = read(fin, read_edge_buffer, edge_unit_size * CHUNKSIZE);
-        } else {
-          curr_read_bytes = read(fin, read_edge_buffer, bytes_to_read - read_bytes);
-        }
-        assert(curr_read_bytes>=0);
-        read_bytes += curr_read_bytes;
-        EdgeId curr_read_edges = curr_read_bytes / edge_unit_size;
+      for (EdgeId chunk_e_i=0;chunk_e_i<read_edges;chunk_e_i+=CHUNKSIZE) {
+        EdgeUnit<EdgeData> * read_edge_buffer = edge_slice + chunk_e_i;
+        EdgeId curr_read_edges = std::min(read_edges - chunk_e_i, (EdgeId)CHUNKSIZE);
+        edge_file.prefetch(edge_unit_size * (chunk_e_i + CHUNKSIZE), edge_unit_size * CHUNKSIZE);
         for (EdgeId e_i=0;e_i<curr_read_edges;e_i++) {
-          VertexId dst = read_edge_buffer[e_i].dst;
-          int i = get_partition_id(dst);
-          memcpy(send_buffer[i].data() + edge_unit_size * buffered_edges[i], &read_edge_buffer[e_i], edge_unit_size);
+          EdgeUnit<EdgeData> edge = read_edge_buffer[e_i];
+          relabel_edge(edge);
+          int i = get_partition_id(edge.dst);
+          memcpy(send_buffer[i].data() + edge_unit_size * buffered_edges[i], &edge, edge_unit_size);
           buffered_edges[i] += 1;
           if (buffered_edges[i] == CHUNKSIZE) {
             MPI_Send(send_buffer[i].data(), edge_unit_size * buffered_edges[i], MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD);
@@ -1002,25 +1702,21 @@ public:
     for (int s_i=0;s_i<sockets;s_i++) {
       outgoing_edges[s_i] = 0;
       compressed_outgoing_adj_vertices[s_i] = 0;
-      for (VertexId v_i=0;v_i<vertices;v_i++) {
-        if (outgoing_adj_bitmap[s_i]->get_bit(v_i)) {
-          outgoing_edges[s_i] += outgoing_adj_index[s_i][v_i];
-          compressed_outgoing_adj_vertices[s_i] += 1;
-        }
-      }
+      outgoing_adj_bitmap[s_i]->for_each_bit(0, vertices, [&](VertexId v_i){
+        outgoing_edges[s_i] += outgoing_adj_index[s_i][v_i];
+        compressed_outgoing_adj_vertices[s_i] += 1;
+      });
       compressed_outgoing_adj_index[s_i] = (CompressedAdjIndexUnit*)numa_alloc_onnode( sizeof(CompressedAdjIndexUnit) * (compressed_outgoing_adj_vertices[s_i] + 1) , s_i );
       compressed_outgoing_adj_index[s_i][0].index = 0;
       EdgeId last_e_i = 0;
       compressed_outgoing_adj_vertices[s_i] = 0;
-      for (VertexId v_i=0;v_i<vertices;v_i++) {
-        if (outgoing_adj_bitmap[s_i]->get_bit(v_i)) {
-          outgoing_adj_index[s_i][v_i] = last_e_i + outgoing_adj_index[s_i][v_i];
-          last_e_i = outgoing_adj_index[s_i][v_i];
-          compressed_outgoing_adj_index[s_i][compressed_outgoing_adj_vertices[s_i]].vertex = v_i;
-          compressed_outgoing_adj_vertices[s_i] += 1;
-          compressed_outgoing_adj_index[s_i][compressed_outgoing_adj_vertices[s_i]].index = last_e_i;
-        }
-      }
+      outgoing_adj_bitmap[s_i]->for_each_bit(0, vertices, [&](VertexId v_i){
+        outgoing_adj_index[s_i][v_i] = last_e_i + outgoing_adj_index[s_i][v_i];
+        last_e_i = outgoing_adj_index[s_i][v_i];
+        compressed_outgoing_adj_index[s_i][compressed_outgoing_adj_vertices[s_i]].vertex = v_i;
+        compressed_outgoing_adj_vertices[s_i] += 1;
+        compressed_outgoing_adj_index[s_i][compressed_outgoing_adj_vertices[s_i]].index = last_e_i;
+      });
       for (VertexId p_v_i=0;p_v_i<compressed_outgoing_adj_vertices[s_i];p_v_i++) {
         VertexId v_i = compressed_outgoing_adj_index[s_i][p_v_i].vertex;
         outgoing_adj_index[s_i][v_i] = compressed_outgoing_adj_index[s_i][p_v_i].index;
@@ -1033,23 +1729,7 @@ public:
     }
     {
       std::thread recv_thread_dst([&](){
-        int finished_count = 0;
-        MPI_Status recv_status;
-        while (finished_count < partitions) {
-          MPI_Probe(MPI_ANY_SOURCE, ShuffleGraph, MPI_COMM_WORLD, &recv_status);
-          int i = recv_status.MPI_SOURCE;
-          assert(recv_status.MPI_TAG == ShuffleGraph && i >=0 && i < partitions);
-          int recv_bytes;
-          MPI_Get_count(&recv_status, MPI_CHAR, &recv_bytes);
-          if (recv_bytes==1) {
-            finished_count += 1;
-            char c;
-            MPI_Recv(&c, 1, MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            continue;
-          }
-          assert(recv_bytes % edge_unit_size == 0);
-          int recv_edges = recv_bytes / edge_unit_size;
-          MPI_Recv(recv_buffer, edge_unit_size * recv_edges, MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        recv_shuffled_edges([&](EdgeUnit<EdgeData> * recv_buffer, EdgeId recv_edges){
           #pragma omp parallel for
           for (EdgeId e_i=0;e_i<recv_edges;e_i++) {
             VertexId src = recv_buffer[e_i].src;
@@ -1062,27 +1742,20 @@ public:
               outgoing_adj_list[dst_part][pos].edge_data = recv_buffer[e_i].edge_data;
             }
           }
-        }
+        });
       });
       for (int i=0;i<partitions;i++) {
         buffered_edges[i] = 0;
       }
-      assert(lseek(fin, read_offset, SEEK_SET)==read_offset);
-      read_bytes = 0;
-      while (read_bytes < bytes_to_read) {
-        long curr_read_bytes;
-        if (bytes_to_read - read_bytes > edge_unit_size * CHUNKSIZE) {
-          curr_read_bytes = read(fin, read_edge_buffer, edge_unit_size * CHUNKSIZE);
-        } else {
-          curr_read_bytes = read(fin, read_edge_buffer, bytes_to_read - read_bytes);
-        }
-        assert(curr_read_bytes>=0);
-        read_bytes += curr_read_bytes;
-        EdgeId curr_read_edges = curr_read_bytes / edge_unit_size;
+      for (EdgeId chunk_e_i=0;chunk_e_i<read_edges;chunk_e_i+=CHUNKSIZE) {
+        EdgeUnit<EdgeData> * read_edge_buffer = edge_slice + chunk_e_i;
+        EdgeId curr_read_edges = std::min(read_edges - chunk_e_i, (EdgeId)CHUNKSIZE);
+        edge_file.prefetch(edge_unit_size * (chunk_e_i + CHUNKSIZE), edge_unit_size * CHUNKSIZE);
         for (EdgeId e_i=0;e_i<curr_read_edges;e_i++) {
-          VertexId dst = read_edge_buffer[e_i].dst;
-          int i = get_partition_id(dst);
-          memcpy(send_buffer[i].data() + edge_unit_size * buffered_edges[i], &read_edge_buffer[e_i], edge_unit_size);
+          EdgeUnit<EdgeData> edge = read_edge_buffer[e_i];
+          relabel_edge(edge);
+          int i = get_partition_id(edge.dst);
+          memcpy(send_buffer[i].data() + edge_unit_size * buffered_edges[i], &edge, edge_unit_size);
           buffered_edges[i] += 1;
           if (buffered_edges[i] == CHUNKSIZE) {
             MPI_Send(send_buffer[i].data(), edge_unit_size * buffered_edges[i], MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD);
@@ -1116,30 +1789,18 @@ public:
     incoming_adj_list = new AdjUnit<EdgeData>* [sockets];
     incoming_adj_bitmap = new Bitmap * [sockets];
     for (int s_i=0;s_i<sockets;s_i++) {
-      incoming_adj_bitmap[s_i] = new Bitmap (vertices);
+      incoming_adj_bitmap[s_i] = new Bitmap (vertices, s_i);
       incoming_adj_bitmap[s_i]->clear();
       incoming_adj_index[s_i] = (EdgeId*)numa_alloc_onnode(sizeof(EdgeId) * (vertices+1), s_i);
+      #pragma omp parallel for
+      for (VertexId v_i=0;v_i<=vertices;v_i++) {
+        incoming_adj_index[s_i][v_i] = 0;
+      }
     }
     {
       std::thread recv_thread_src([&](){
-        int finished_count = 0;
-        MPI_Status recv_status;
-        while (finished_count < partitions) {
-          MPI_Probe(MPI_ANY_SOURCE, ShuffleGraph, MPI_COMM_WORLD, &recv_status);
-          int i = recv_status.MPI_SOURCE;
-          assert(recv_status.MPI_TAG == ShuffleGraph && i >=0 && i < partitions);
-          int recv_bytes;
-          MPI_Get_count(&recv_status, MPI_CHAR, &recv_bytes);
-          if (recv_bytes==1) {
-            finished_count += 1;
-            char c;
-            MPI_Recv(&c, 1, MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            continue;
-          }
-          assert(recv_bytes % edge_unit_size == 0);
-          int recv_edges = recv_bytes / edge_unit_size;
-          MPI_Recv(recv_buffer, edge_unit_size * recv_edges, MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-          // #pragma omp parallel for
+        recv_shuffled_edges([&](EdgeUnit<EdgeData> * recv_buffer, EdgeId recv_edges){
+          #pragma omp parallel for
           for (EdgeId e_i=0;e_i<recv_edges;e_i++) {
             VertexId src = recv_buffer[e_i].src;
             VertexId dst = recv_buffer[e_i].dst;
@@ -1147,32 +1808,24 @@ public:
             int src_part = get_local_partition_id(src);
             if (!incoming_adj_bitmap[src_part]->get_bit(dst)) {
               incoming_adj_bitmap[src_part]->set_bit(dst);
-              incoming_adj_index[src_part][dst] = 0;
             }
             __sync_fetch_and_add(&incoming_adj_index[src_part][dst], 1);
           }
           recv_incoming_edges += recv_edges;
-        }
+        });
       });
       for (int i=0;i<partitions;i++) {
         buffered_edges[i] = 0;
       }
-      assert(lseek(fin, read_offset, SEEK_SET)==read_offset);
-      read_bytes = 0;
-      while (read_bytes < bytes_to_read) {
-        long curr_read_bytes;
-        if (bytes_to_read - read_bytes > edge_unit_size * CHUNKSIZE) {
-          curr_read_bytes = read(fin, read_edge_buffer, edge_unit_size * CHUNKSIZE);
-        } else {
-          curr_read_bytes = read(fin, read_edge_buffer, bytes_to_read - read_bytes);
-        }
-        assert(curr_read_bytes>=0);
-        read_bytes += curr_read_bytes;
-        EdgeId curr_read_edges = curr_read_bytes / edge_unit_size;
+      for (EdgeId chunk_e_i=0;chunk_e_i<read_edges;chunk_e_i+=CHUNKSIZE) {
+        EdgeUnit<EdgeData> * read_edge_buffer = edge_slice + chunk_e_i;
+        EdgeId curr_read_edges = std::min(read_edges - chunk_e_i, (EdgeId)CHUNKSIZE);
+        edge_file.prefetch(edge_unit_size * (chunk_e_i + CHUNKSIZE), edge_unit_size * CHUNKSIZE);
         for (EdgeId e_i=0;e_i<curr_read_edges;e_i++) {
-          VertexId src = read_edge_buffer[e_i].src;
-          int i = get_partition_id(src);
-          memcpy(send_buffer[i].data() + edge_unit_size * buffered_edges[i], &read_edge_buffer[e_i], edge_unit_size);
+          EdgeUnit<EdgeData> edge = read_edge_buffer[e_i];
+          relabel_edge(edge);
+          int i = get_partition_id(edge.src);
+          memcpy(send_buffer[i].data() + edge_unit_size * buffered_edges[i], &edge, edge_unit_size);
           buffered_edges[i] += 1;
           if (buffered_edges[i] == CHUNKSIZE) {
             MPI_Send(send_buffer[i].data(), edge_unit_size * buffered_edges[i], MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD);
@@ -1199,25 +1852,21 @@ public:
     for (int s_i=0;s_i<sockets;s_i++) {
       incoming_edges[s_i] = 0;
       compressed_incoming_adj_vertices[s_i] = 0;
-      for (VertexId v_i=0;v_i<vertices;v_i++) {
-        if (incoming_adj_bitmap[s_i]->get_bit(v_i)) {
-          incoming_edges[s_i] += incoming_adj_index[s_i][v_i];
-          compressed_incoming_adj_vertices[s_i] += 1;
-        }
-      }
+      incoming_adj_bitmap[s_i]->for_each_bit(0, vertices, [&](VertexId v_i){
+        incoming_edges[s_i] += incoming_adj_index[s_i][v_i];
+        compressed_incoming_adj_vertices[s_i] += 1;
+      });
       compressed_incoming_adj_index[s_i] = (CompressedAdjIndexUnit*)numa_alloc_onnode( sizeof(CompressedAdjIndexUnit) * (compressed_incoming_adj_vertices[s_i] + 1) , s_i );
       compressed_incoming_adj_index[s_i][0].index = 0;
       EdgeId last_e_i = 0;
       compressed_incoming_adj_vertices[s_i] = 0;
-      for (VertexId v_i=0;v_i<vertices;v_i++) {
-        if (incoming_adj_bitmap[s_i]->get_bit(v_i)) {
-          incoming_adj_index[s_i][v_i] = last_e_i + incoming_adj_index[s_i][v_i];
-          last_e_i = incoming_adj_index[s_i][v_i];
-          compressed_incoming_adj_index[s_i][compressed_incoming_adj_vertices[s_i]].vertex = v_i;
-          compressed_incoming_adj_vertices[s_i] += 1;
-          compressed_incoming_adj_index[s_i][compressed_incoming_adj_vertices[s_i]].index = last_e_i;
-        }
-      }
+      incoming_adj_bitmap[s_i]->for_each_bit(0, vertices, [&](VertexId v_i){
+        incoming_adj_index[s_i][v_i] = last_e_i + incoming_adj_index[s_i][v_i];
+        last_e_i = incoming_adj_index[s_i][v_i];
+        compressed_incoming_adj_index[s_i][compressed_incoming_adj_vertices[s_i]].vertex = v_i;
+        compressed_incoming_adj_vertices[s_i] += 1;
+        compressed_incoming_adj_index[s_i][compressed_incoming_adj_vertices[s_i]].index = last_e_i;
+      });
       for (VertexId p_v_i=0;p_v_i<compressed_incoming_adj_vertices[s_i];p_v_i++) {
         VertexId v_i = compressed_incoming_adj_index[s_i][p_v_i].vertex;
         incoming_adj_index[s_i][v_i] = compressed_incoming_adj_index[s_i][p_v_i].index;
@@ -1230,23 +1879,7 @@ public:
     }
     {
       std::thread recv_thread_src([&](){
-        int finished_count = 0;
-        MPI_Status recv_status;
-        while (finished_count < partitions) {
-          MPI_Probe(MPI_ANY_SOURCE, ShuffleGraph, MPI_COMM_WORLD, &recv_status);
-          int i = recv_status.MPI_SOURCE;
-          assert(recv_status.MPI_TAG == ShuffleGraph && i >=0 && i < partitions);
-          int recv_bytes;
-          MPI_Get_count(&recv_status, MPI_CHAR, &recv_bytes);
-          if (recv_bytes==1) {
-            finished_count += 1;
-            char c;
-            MPI_Recv(&c, 1, MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            continue;
-          }
-          assert(recv_bytes % edge_unit_size == 0);
-          int recv_edges = recv_bytes / edge_unit_size;
-          MPI_Recv(recv_buffer, edge_unit_size * recv_edges, MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        recv_shuffled_edges([&](EdgeUnit<EdgeData> * recv_buffer, EdgeId recv_edges){
           #pragma omp parallel for
           for (EdgeId e_i=0;e_i<recv_edges;e_i++) {
             VertexId src = recv_buffer[e_i].src;
@@ -1259,27 +1892,20 @@ public:
               incoming_adj_list[src_part][pos].edge_data = recv_buffer[e_i].edge_data;
             }
           }
-        }
+        });
       });
       for (int i=0;i<partitions;i++) {
         buffered_edges[i] = 0;
       }
-      assert(lseek(fin, read_offset, SEEK_SET)==read_offset);
-      read_bytes = 0;
-      while (read_bytes < bytes_to_read) {
-        long curr_read_bytes;
-        if (bytes_to_read - read_bytes > edge_unit_size * CHUNKSIZE) {
-          curr_read_bytes = read(fin, read_edge_buffer, edge_unit_size * CHUNKSIZE);
-        } else {
-          curr_read_bytes = read(fin, read_edge_buffer, bytes_to_read - read_bytes);
-        }
-        assert(curr_read_bytes>=0);
-        read_bytes += curr_read_bytes;
-        EdgeId curr_read_edges = curr_read_bytes / edge_unit_size;
+      for (EdgeId chunk_e_i=0;chunk_e_i<read_edges;chunk_e_i+=CHUNKSIZE) {
+        EdgeUnit<EdgeData> * read_edge_buffer = edge_slice + chunk_e_i;
+        EdgeId curr_read_edges = std::min(read_edges - chunk_e_i, (EdgeId)CHUNKSIZE);
+        edge_file.prefetch(edge_unit_size * (chunk_e_i + CHUNKSIZE), edge_unit_size * CHUNKSIZE);
         for (EdgeId e_i=0;e_i<curr_read_edges;e_i++) {
-          VertexId src = read_edge_buffer[e_i].src;
-          int i = get_partition_id(src);
-          memcpy(send_buffer[i].data() + edge_unit_size * buffered_edges[i], &read_edge_buffer[e_i], edge_unit_size);
+          EdgeUnit<EdgeData> edge = read_edge_buffer[e_i];
+          relabel_edge(edge);
+          int i = get_partition_id(edge.src);
+          memcpy(send_buffer[i].data() + edge_unit_size * buffered_edges[i], &edge, edge_unit_size);
           buffered_edges[i] += 1;
           if (buffered_edges[i] == CHUNKSIZE) {
             MPI_Send(send_buffer[i].data(), edge_unit_size * buffered_edges[i], MPI_CHAR, i, ShuffleGraph, MPI_COMM_WORLD);
@@ -1309,9 +1935,6 @@ public:
 
     delete [] buffered_edges;
     delete [] send_buffer;
-    delete [] read_edge_buffer;
-    delete [] recv_buffer;
-    close(fin);
 
     transpose();
     tune_chunks();
@@ -1392,71 +2015,189 @@ public:
     }
   }
 
-  // process vertices
-  template<typename R>
-  R process_vertices(std::function<R(VertexId)> process, Bitmap * active) {
+  // allocate the message buffers of a job slot on first use
+  MessageBufferPool * get_message_buffers(int id) {
+    MessageBufferPool * pool = &buffer_pool[id];
+    if (pool->initialized) {
+      return pool;
+    }
+    pool->thread_state = new ThreadState * [threads];
+    pool->local_send_buffer = new MessageBuffer * [threads];
+    for (int t_i=0;t_i<threads;t_i++) {
+      pool->thread_state[t_i] = (ThreadState*)numa_alloc_onnode(sizeof(ThreadState), get_socket_id(t_i));
+      pool->local_send_buffer[t_i] = (MessageBuffer*)numa_alloc_onnode(sizeof(MessageBuffer), get_socket_id(t_i));
+      pool->local_send_buffer[t_i]->init(get_socket_id(t_i));
+    }
+    pool->send_buffer = new MessageBuffer ** [partitions];
+    pool->recv_buffer = new MessageBuffer ** [partitions];
+    pool->wire_send_buffer = new MessageBuffer ** [partitions];
+    pool->wire_recv_buffer = new MessageBuffer ** [partitions];
+    for (int i=0;i<partitions;i++) {
+      pool->send_buffer[i] = new MessageBuffer * [sockets];
+      pool->recv_buffer[i] = new MessageBuffer * [sockets];
+      pool->wire_send_buffer[i] = new MessageBuffer * [sockets];
+      pool->wire_recv_buffer[i] = new MessageBuffer * [sockets];
+      for (int s_i=0;s_i<sockets;s_i++) {
+        pool->send_buffer[i][s_i] = (MessageBuffer*)numa_alloc_onnode(sizeof(MessageBuffer), s_i);
+        pool->send_buffer[i][s_i]->init(s_i);
+        pool->recv_buffer[i][s_i] = (MessageBuffer*)numa_alloc_onnode(sizeof(MessageBuffer), s_i);
+        pool->recv_buffer[i][s_i]->init(s_i);
+        pool->wire_send_buffer[i][s_i] = (MessageBuffer*)numa_alloc_onnode(sizeof(MessageBuffer), s_i);
+        pool->wire_send_buffer[i][s_i]->init(s_i);
+        pool->wire_recv_buffer[i][s_i] = (MessageBuffer*)numa_alloc_onnode(sizeof(MessageBuffer), s_i);
+        pool->wire_recv_buffer[i][s_i]->init(s_i);
+      }
+    }
+    pool->initialized = true;
+    return pool;
+  }
 
-    ThreadState **thread_state; // ThreadState* [threads]; numa-aware
-    MessageBuffer **local_send_buffer; // MessageBuffer* [threads]; numa-aware
+  // release the message buffers of a job slot
+  void free_message_buffers(int id) {
+    MessageBufferPool * pool = &buffer_pool[id];
+    if (!pool->initialized) {
+      return;
+    }
+    for (int t_i=0;t_i<threads;t_i++) {
+      numa_free(pool->thread_state[t_i], sizeof(ThreadState));
+      pool->local_send_buffer[t_i]->release();
+      numa_free(pool->local_send_buffer[t_i], sizeof(MessageBuffer));
+    }
+    delete [] pool->thread_state;
+    delete [] pool->local_send_buffer;
+    for (int i=0;i<partitions;i++) {
+      for (int s_i=0;s_i<sockets;s_i++) {
+        pool->send_buffer[i][s_i]->release();
+        numa_free(pool->send_buffer[i][s_i], sizeof(MessageBuffer));
+        pool->recv_buffer[i][s_i]->release();
+        numa_free(pool->recv_buffer[i][s_i], sizeof(MessageBuffer));
+        pool->wire_send_buffer[i][s_i]->release();
+        numa_free(pool->wire_send_buffer[i][s_i], sizeof(MessageBuffer));
+        pool->wire_recv_buffer[i][s_i]->release();
+        numa_free(pool->wire_recv_buffer[i][s_i], sizeof(MessageBuffer));
+      }
+      delete [] pool->send_buffer[i];
+      delete [] pool->recv_buffer[i];
+      delete [] pool->wire_send_buffer[i];
+      delete [] pool->wire_recv_buffer[i];
+    }
+    delete [] pool->send_buffer;
+    delete [] pool->recv_buffer;
+    delete [] pool->wire_send_buffer;
+    delete [] pool->wire_recv_buffer;
+    if (pool->combine_owner!=NULL) {
+      numa_free(pool->combine_owner, sizeof(unsigned long) * vertices);
+    }
+    *pool = MessageBufferPool();
+  }
 
-    thread_state = new ThreadState *[threads];
-    local_send_buffer = new MessageBuffer *[threads];
-    for (int t_i = 0; t_i < threads; t_i++)
-    {
-      thread_state[t_i] = (ThreadState *)numa_alloc_onnode(sizeof(ThreadState), get_socket_id(t_i));
-      local_send_buffer[t_i] = (MessageBuffer *)numa_alloc_onnode(sizeof(MessageBuffer), get_socket_id(t_i));
-      local_send_buffer[t_i]->init(get_socket_id(t_i));
+  // force the mode of the process_edges calls of job id; AutoDirection lets the policy decide
+  void set_direction_mode(DirectionMode mode, int id = 0) {
+    direction_mode[id] = mode;
+  }
+
+  // replace the sparse/dense decision of job id (returns true for sparse mode);
+  // every partition must reach the same decision, so do not rely on DirectionStats::time
+  void set_direction_policy(std::function<bool(const DirectionStats &, const std::vector<DirectionStats> &)> policy, int id = 0) {
+    direction_policy[id] = policy;
+  }
+
+  // one entry per process_edges call of job id, oldest first; only the last DIRECTION_HISTORY calls are kept
+  const std::vector<DirectionStats> & get_direction_history(int id = 0) {
+    return direction_history[id];
+  }
+
+  void clear_direction_history(int id = 0) {
+    direction_history[id].clear();
+  }
+
+  // default decision: compare the estimated work of both modes in edge visits;
+  // sparse mode writes randomly along the active edges and sends every active vertex to each partition,
+  // dense mode scans all edges and sends up to one message per vertex to each partition
+  bool choose_sparse(const DirectionStats & stats, const std::vector<DirectionStats> & history) {
+    double sparse_cost = (double)SPARSE_EDGE_COST * stats.active_edges + (double)stats.active_vertices * stats.partitions * stats.message_size / unit_size;
+    double dense_cost = (double)edges + (double)vertices * stats.partitions * stats.message_size / unit_size;
+    // keep the previous mode unless the other one is clearly cheaper
+    if (!history.empty()) {
+      if (history.back().sparse) {
+        dense_cost *= DIRECTION_HYSTERESIS;
+      } else {
+        sparse_cost *= DIRECTION_HYSTERESIS;
+      }
+    }
+    return sparse_cost < dense_cost;
+  }
+
+  // scheduling state of process_vertices for the calling thread; concurrent jobs call from
+  // their own threads, so each gets its own set, allocated on its first call and reused afterwards
+  ThreadState ** get_vertex_thread_state() {
+    std::lock_guard<std::mutex> lock(vertex_thread_state_mutex);
+    ThreadState ** & thread_state = vertex_thread_state[std::this_thread::get_id()];
+    if (thread_state==nullptr) {
+      thread_state = new ThreadState * [threads];
+      for (int t_i=0;t_i<threads;t_i++) {
+        thread_state[t_i] = (ThreadState*)numa_alloc_onnode(sizeof(ThreadState), get_socket_id(t_i));
+      }
     }
+    return thread_state;
+  }
 
+  // process vertices; process is any callable VertexId -> R, so it is inlined into the loops
+  template<typename R, typename Process>
+  R process_vertices(Process process, VertexSubset * active) {
     double stream_time = 0;
     stream_time -= MPI_Wtime();
 
     R reducer = 0;
-    size_t basic_chunk = 64;
-    for (int t_i=0;t_i<threads;t_i++) {
-      int s_i = get_socket_id(t_i);
-      int s_j = get_socket_offset(t_i);
-      VertexId partition_size = local_partition_offset[s_i+1] - local_partition_offset[s_i];
-      thread_state[t_i]->curr = local_partition_offset[s_i] + partition_size / threads_per_socket  / basic_chunk * basic_chunk * s_j;
-      thread_state[t_i]->end = local_partition_offset[s_i] + partition_size / threads_per_socket / basic_chunk * basic_chunk * (s_j+1);
-      if (s_j == threads_per_socket - 1) {
-        thread_state[t_i]->end = local_partition_offset[s_i+1];
+    if (active->is_sparse()) {
+      // few active vertices: walk the list instead of the bitmap
+      #pragma omp parallel for reduction(+:reducer)
+      for (size_t l_i=0;l_i<active->list_size;l_i++) {
+        VertexId v_i = active->list[l_i];
+        if (v_i >= partition_offset[partition_id] && v_i < partition_offset[partition_id+1]) {
+          reducer += process(v_i);
+        }
       }
-      thread_state[t_i]->status = WORKING;
-    }
-    #pragma omp parallel reduction(+:reducer)
-    {
-      R local_reducer = 0;
-      int thread_id = omp_get_thread_num();
-      while (true) {
-        VertexId v_i = __sync_fetch_and_add(&thread_state[thread_id]->curr, basic_chunk);
-        if (v_i >= thread_state[thread_id]->end) break;
-        unsigned long word = active->data[WORD_OFFSET(v_i)];
-        while (word != 0) {
-          if (word & 1) {
-            local_reducer += process(v_i);
-          }
-          v_i++;
-          word = word >> 1;
+    } else {
+      ThreadState ** thread_state = get_vertex_thread_state();
+      VertexId basic_chunk = VERTEX_CHUNK;
+      for (int t_i=0;t_i<threads;t_i++) {
+        int s_i = get_socket_id(t_i);
+        int s_j = get_socket_offset(t_i);
+        VertexId partition_size = local_partition_offset[s_i+1] - local_partition_offset[s_i];
+        thread_state[t_i]->curr = local_partition_offset[s_i] + partition_size / threads_per_socket  / basic_chunk * basic_chunk * s_j;
+        thread_state[t_i]->end = local_partition_offset[s_i] + partition_size / threads_per_socket / basic_chunk * basic_chunk * (s_j+1);
+        if (s_j == threads_per_socket - 1) {
+          thread_state[t_i]->end = local_partition_offset[s_i+1];
         }
+        thread_state[t_i]->status = WORKING;
       }
-      thread_state[thread_id]->status = STEALING;
-      for (int t_offset=1;t_offset<threads;t_offset++) {
-        int t_i = (thread_id + t_offset) % threads;
-        while (thread_state[t_i]->status!=STEALING) {
-          VertexId v_i = __sync_fetch_and_add(&thread_state[t_i]->curr, basic_chunk);
-          if (v_i >= thread_state[t_i]->end) continue;
-          unsigned long word = active->data[WORD_OFFSET(v_i)];
-          while (word != 0) {
-            if (word & 1) {
-              local_reducer += process(v_i);
-            }
-            v_i++;
-            word = word >> 1;
+      #pragma omp parallel reduction(+:reducer)
+      {
+        R local_reducer = 0;
+        int thread_id = omp_get_thread_num();
+        while (true) {
+          VertexId v_i = __sync_fetch_and_add(&thread_state[thread_id]->curr, basic_chunk);
+          if (v_i >= thread_state[thread_id]->end) break;
+          active->for_each_bit(v_i, std::min(v_i + basic_chunk, thread_state[thread_id]->end), [&](VertexId vtx){
+            local_reducer += process(vtx);
+          });
+        }
+        thread_state[thread_id]->status = STEALING;
+        for (int t_offset=1;t_offset<threads;t_offset++) {
+          int t_i = (thread_id + t_offset) % threads;
+          while (thread_state[t_i]->status!=STEALING) {
+            VertexId v_i = __sync_fetch_and_add(&thread_state[t_i]->curr, basic_chunk);
+            // stop at the first exhausted chunk; spinning until the victim turns STEALING
+            // would keep bumping curr and could wrap it around into vertices already processed
+            if (v_i >= thread_state[t_i]->end) break;
+            active->for_each_bit(v_i, std::min(v_i + basic_chunk, thread_state[t_i]->end), [&](VertexId vtx){
+              local_reducer += process(vtx);
+            });
           }
         }
+        reducer += local_reducer;
       }
-      reducer += local_reducer;
     }
     R global_reducer;
     MPI_Datatype dt = get_mpi_data_type<R>();
@@ -1470,6 +2211,12 @@ public:
     return global_reducer;
   }
 
+  // type-erased form for callers that keep their callbacks in std::function
+  template<typename R>
+  R process_vertices(std::function<R(VertexId)> process, VertexSubset * active) {
+    return process_vertices<R, std::function<R(VertexId)> &>(process, active);
+  }
+
   // template<typename M>
   // void flush_local_send_buffer(int t_i) {
   //   int s_i = get_socket_id(t_i);
@@ -1478,6 +2225,205 @@ public:
   //   local_send_buffer[t_i]->count = 0;
   // }
 
+  // merge dense-mode messages of job id bound for the same vertex before they are sent (sparse messages
+  // are keyed by their source, which emits once, so there is nothing to merge there);
+  // combine must be associative and commutative, and dense_slot must accept the merged message
+  template<typename M>
+  void set_message_combiner(std::function<M(M, M)> combine, int id = 0) {
+    message_combiner_size[id] = sizeof(M);
+    message_combiner[id] = [combine](void * into, const void * from) {
+      M a, b; // message units are packed, so copy out of them
+      memcpy(&a, into, sizeof(M));
+      memcpy(&b, from, sizeof(M));
+      a = combine(a, b);
+      memcpy(into, &a, sizeof(M));
+    };
+  }
+
+  void clear_message_combiner(int id = 0) {
+    message_combiner[id] = nullptr;
+  }
+
+  // merge the messages in buffer [sockets] per destination vertex with the combiner of job id;
+  // the first message seen for a vertex absorbs the others, which are then compacted away
+  template<typename M>
+  void combine_messages(MessageBuffer ** buffer, int id) {
+    assert(message_combiner_size[id]==sizeof(M));
+    MessageBufferPool * pool = &buffer_pool[id];
+    if (pool->combine_owner==NULL) {
+      pool->combine_owner = (unsigned long *)numa_alloc_interleaved(sizeof(unsigned long) * vertices);
+      assert(pool->combine_owner!=NULL);
+    }
+    unsigned long * combine_owner = pool->combine_owner; // 0, or 1 + (socket << 32 | index) of the absorbing message
+    const unsigned long locked = 1ul << 63;
+    const VertexId merged = (VertexId)-1;
+    std::function<void(void *, const void *)> & combine = message_combiner[id];
+    for (int s_i=0;s_i<sockets;s_i++) {
+      MsgUnit<M> * units = (MsgUnit<M> *)buffer[s_i]->data;
+      #pragma omp parallel for
+      for (int m_i=0;m_i<buffer[s_i]->count;m_i++) {
+        VertexId vtx = units[m_i].vertex;
+        unsigned long self = (((unsigned long)s_i << 32) | m_i) + 1;
+        unsigned long owner;
+        while (true) {
+          owner = combine_owner[vtx];
+          if (owner==0) {
+            if (__sync_bool_compare_and_swap(&combine_owner[vtx], 0, self)) break;
+          } else if (!(owner & locked)) {
+            if (__sync_bool_compare_and_swap(&combine_owner[vtx], owner, owner | locked)) break;
+          } else {
+            __asm volatile ("pause" ::: "memory");
+          }
+        }
+        if (owner==0) continue;
+        owner -= 1;
+        MsgUnit<M> * target = (MsgUnit<M> *)buffer[owner >> 32]->data + (owner & 0xffffffff);
+        combine(&target->msg_data, &units[m_i].msg_data);
+        units[m_i].vertex = merged;
+        __sync_synchronize();
+        combine_owner[vtx] = owner + 1;
+      }
+    }
+    #pragma omp parallel for
+    for (int s_i=0;s_i<sockets;s_i++) {
+      MsgUnit<M> * units = (MsgUnit<M> *)buffer[s_i]->data;
+      int count = 0;
+      for (int m_i=0;m_i<buffer[s_i]->count;m_i++) {
+        if (units[m_i].vertex==merged) continue;
+        combine_owner[units[m_i].vertex] = 0;
+        units[count++] = units[m_i];
+      }
+      buffer[s_i]->count = count;
+    }
+  }
+
+  // encode the messages of job id before they are sent (vertex id deltas as varints, raw payloads)
+  void set_message_compression(bool enabled, int id = 0) {
+    message_compression[id] = enabled;
+  }
+
+  // apply received dense-mode messages between the signal phases of later partitions instead of after all of them;
+  // only valid if dense_slot never writes what dense_signal of the same superstep reads
+  void set_dense_overlap(bool enabled, int id = 0) {
+    dense_overlap[id] = enabled;
+  }
+
+  // ThreadedTransport: a send thread and probing recv thread(s) per superstep;
+  // NonblockingTransport: MPI_Isend / MPI_Irecv from the calling thread, received buffers applied in arrival order
+  void set_message_transport(MessageTransport transport, int id = 0) {
+    message_transport[id] = transport;
+  }
+
+  CodecStats get_codec_stats(int id = 0) {
+    std::lock_guard<std::mutex> lock(codec_stats_mutex);
+    return codec_stats[id];
+  }
+
+  void clear_codec_stats(int id = 0) {
+    std::lock_guard<std::mutex> lock(codec_stats_mutex);
+    memset(&codec_stats[id], 0, sizeof(CodecStats));
+  }
+
+  // encode buffer into wire_buffer if message compression is on for job id;
+  // returns the bytes to put on the wire and sets bytes to their size
+  template<typename M>
+  char * pack_messages(MessageBuffer * buffer, MessageBuffer * wire_buffer, size_t & bytes, int id) {
+    bytes = sizeof(MsgUnit<M>) * buffer->count;
+    if (!message_compression[id]) {
+      return buffer->data;
+    }
+    double encode_time = 0;
+    encode_time -= MPI_Wtime();
+    wire_buffer->resize(max_encoded_messages_size(buffer->count, sizeof(MsgUnit<M>)));
+    size_t raw_bytes = bytes;
+    bytes = encode_messages(buffer->data, buffer->count, sizeof(MsgUnit<M>), (unsigned char *)wire_buffer->data);
+    encode_time += MPI_Wtime();
+    std::lock_guard<std::mutex> lock(codec_stats_mutex);
+    codec_stats[id].encode_time += encode_time;
+    codec_stats[id].raw_bytes += raw_bytes;
+    codec_stats[id].wire_bytes += bytes;
+    return wire_buffer->data;
+  }
+
+  // set buffer->count from the recv_bytes received into buffer (or into wire_buffer if message compression is on)
+  template<typename M>
+  void unpack_messages(MessageBuffer * buffer, MessageBuffer * wire_buffer, int recv_bytes, int id) {
+    if (!message_compression[id]) {
+      buffer->count = recv_bytes / sizeof(MsgUnit<M>);
+      return;
+    }
+    double decode_time = 0;
+    decode_time -= MPI_Wtime();
+    buffer->count = decode_messages((unsigned char *)wire_buffer->data, recv_bytes, sizeof(MsgUnit<M>), buffer->data, buffer->capacity / sizeof(MsgUnit<M>));
+    decode_time += MPI_Wtime();
+    std::lock_guard<std::mutex> lock(codec_stats_mutex);
+    codec_stats[id].decode_time += decode_time;
+  }
+
+  // receive one socket buffer of messages from partition i into buffer, decoding it if message compression is on
+  template<typename M>
+  void recv_messages(int i, MessageBuffer * buffer, MessageBuffer * wire_buffer, int id) {
+    MPI_Status recv_status;
+    MPI_Probe(i, PassMessage, MPI_COMM_WORLD, &recv_status);
+    int recv_bytes;
+    MPI_Get_count(&recv_status, MPI_CHAR, &recv_bytes);
+    if (message_compression[id]) {
+      wire_buffer->resize(recv_bytes);
+      MPI_Recv(wire_buffer->data, recv_bytes, MPI_CHAR, i, PassMessage, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    } else {
+      MPI_Recv(buffer->data, recv_bytes, MPI_CHAR, i, PassMessage, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+    unpack_messages<M>(buffer, wire_buffer, recv_bytes, id);
+  }
+
+  // post a receive for every socket buffer of every other partition;
+  // the recv buffers are already sized for the most messages a partition can send
+  template<typename M>
+  void post_message_recvs(MessageBufferPool * pool, MessageRequests & requests, int id) {
+    for (int i=0;i<partitions;i++) {
+      if (i==partition_id) {
+        requests.pending[i] = 0;
+        continue;
+      }
+      for (int s_i=0;s_i<sockets;s_i++) {
+        MessageBuffer * buffer = pool->recv_buffer[i][s_i];
+        if (message_compression[id]) {
+          MessageBuffer * wire_buffer = pool->wire_recv_buffer[i][s_i];
+          wire_buffer->resize(max_encoded_messages_size(buffer->capacity / sizeof(MsgUnit<M>), sizeof(MsgUnit<M>)));
+          buffer = wire_buffer;
+        }
+        MPI_Irecv(buffer->data, buffer->capacity, MPI_CHAR, i, PassMessage, MPI_COMM_WORLD, &requests.recv[i * sockets + s_i]);
+      }
+    }
+  }
+
+  // wait until every socket buffer of some other partition has arrived; returns that partition
+  // with block = false, returns -1 instead of waiting once no further buffer has arrived
+  template<typename M>
+  int wait_message_recvs(MessageBufferPool * pool, MessageRequests & requests, int id, bool block = true) {
+    while (true) {
+      int index;
+      MPI_Status recv_status;
+      if (block) {
+        MPI_Waitany(partitions * sockets, requests.recv, &index, &recv_status);
+      } else {
+        int flag;
+        MPI_Testany(partitions * sockets, requests.recv, &index, &flag, &recv_status);
+        if (!flag || index==MPI_UNDEFINED) return -1;
+      }
+      assert(index!=MPI_UNDEFINED);
+      int i = index / sockets;
+      int s_i = index % sockets;
+      int recv_bytes;
+      MPI_Get_count(&recv_status, MPI_CHAR, &recv_bytes);
+      unpack_messages<M>(pool->recv_buffer[i][s_i], pool->wire_recv_buffer[i][s_i], recv_bytes, id);
+      requests.pending[i] -= 1;
+      if (requests.pending[i]==0) {
+        return i;
+      }
+    }
+  }
+
   // emit a message to a vertex's master (dense) / mirror (sparse)
   template<typename M>
   void emit(VertexId vtx, M msg, int id = 0) {
@@ -1499,40 +2445,18 @@ public:
     }
   }
 
-  // process edges
-  template<typename R, typename M>
-  R process_edges(std::function<void(VertexId)> sparse_signal, std::function<R(VertexId, M, VertexAdjList<EdgeData>)> sparse_slot, std::function<void(VertexId, VertexAdjList<EdgeData>)> dense_signal, std::function<R(VertexId, M)> dense_slot, Bitmap * active, Bitmap * dense_selective = nullptr, int id = 0) {
-    ThreadState **thread_state; // ThreadState* [threads]; numa-aware
-
-    MessageBuffer **local_send_buffer; // MessageBuffer* [threads]; numa-aware
+  // process edges; the signals and slots are arbitrary callables with the signatures of the std::function
+  // form below, taken as template parameters so that the per-vertex and per-message calls are inlined
+  template<typename R, typename M, typename SparseSignal, typename SparseSlot, typename DenseSignal, typename DenseSlot>
+  R process_edges(SparseSignal sparse_signal, SparseSlot sparse_slot, DenseSignal dense_signal, DenseSlot dense_slot, VertexSubset * active, VertexSubset * dense_selective = nullptr, int id = 0) {
+    // buffers persist across supersteps and only grow (in bytes) to fit sizeof(MsgUnit<M>)
+    MessageBufferPool * pool = get_message_buffers(id);
+    ThreadState ** thread_state = pool->thread_state;
+    MessageBuffer ** local_send_buffer = pool->local_send_buffer;
 
     int current_send_part_id;
-    MessageBuffer ***send_buffer; // MessageBuffer* [partitions] [sockets]; numa-aware
-    MessageBuffer ***recv_buffer; // MessageBuffer* [partitions] [sockets]; numa-aware
-
-    thread_state = new ThreadState *[threads];
-    local_send_buffer = new MessageBuffer *[threads];
-    for (int t_i = 0; t_i < threads; t_i++)
-    {
-      thread_state[t_i] = (ThreadState *)numa_alloc_onnode(sizeof(ThreadState), get_socket_id(t_i));
-      local_send_buffer[t_i] = (MessageBuffer *)numa_alloc_onnode(sizeof(MessageBuffer), get_socket_id(t_i));
-      local_send_buffer[t_i]->init(get_socket_id(t_i));
-    }
-
-    send_buffer = new MessageBuffer **[partitions];
-    recv_buffer = new MessageBuffer **[partitions];
-    for (int i = 0; i < partitions; i++)
-    {
-      send_buffer[i] = new MessageBuffer *[sockets];
-      recv_buffer[i] = new MessageBuffer *[sockets];
-      for (int s_i = 0; s_i < sockets; s_i++)
-      {
-        send_buffer[i][s_i] = (MessageBuffer *)numa_alloc_onnode(sizeof(MessageBuffer), s_i);
-        send_buffer[i][s_i]->init(s_i);
-        recv_buffer[i][s_i] = (MessageBuffer *)numa_alloc_onnode(sizeof(MessageBuffer), s_i);
-        recv_buffer[i][s_i]->init(s_i);
-      }
-    }
+    MessageBuffer *** send_buffer = pool->send_buffer;
+    MessageBuffer *** recv_buffer = pool->recv_buffer;
 
     double stream_time = 0;
     stream_time -= MPI_Wtime();
@@ -1542,13 +2466,43 @@ public:
       local_send_buffer[t_i]->count = 0;
     }
     R reducer = 0;
-    EdgeId active_edges = process_vertices<EdgeId>(
-      [&](VertexId vtx){
-        return (EdgeId)out_degree[vtx];
-      },
-      active
-    );
-    bool sparse = (active_edges < edges / 20);
+    EdgeId active_edges = 0;
+    EdgeId active_vertices = 0;
+    if (active->is_sparse()) {
+      for (size_t l_i=0;l_i<active->list_size;l_i++) {
+        VertexId v_i = active->list[l_i];
+        if (v_i >= partition_offset[partition_id] && v_i < partition_offset[partition_id+1]) {
+          active_vertices += 1;
+          active_edges += out_degree[v_i];
+        }
+      }
+    } else {
+      #pragma omp parallel for reduction(+:active_edges,active_vertices)
+      for (VertexId begin_v_i=partition_offset[partition_id];begin_v_i<partition_offset[partition_id+1];begin_v_i+=VERTEX_CHUNK) {
+        active->for_each_bit(begin_v_i, std::min(begin_v_i + VERTEX_CHUNK, partition_offset[partition_id+1]), [&](VertexId v_i){
+          active_vertices += 1;
+          active_edges += out_degree[v_i];
+        });
+      }
+    }
+    EdgeId active_counts[2] = {active_edges, active_vertices};
+    MPI_Allreduce(MPI_IN_PLACE, active_counts, 2, get_mpi_data_type<EdgeId>(), MPI_SUM, MPI_COMM_WORLD);
+    DirectionStats stats;
+    stats.active_edges = active_counts[0];
+    stats.active_vertices = active_counts[1];
+    stats.message_size = sizeof(MsgUnit<M>);
+    stats.partitions = partitions;
+    stats.time = 0;
+    if (direction_mode[id]==SparseDirection) {
+      stats.sparse = true;
+    } else if (direction_mode[id]==DenseDirection) {
+      stats.sparse = false;
+    } else if (direction_policy[id]) {
+      stats.sparse = direction_policy[id](stats, direction_history[id]);
+    } else {
+      stats.sparse = choose_sparse(stats, direction_history[id]);
+    }
+    bool sparse = stats.sparse;
     if (sparse) {
       for (int i=0;i<partitions;i++) {
         for (int s_i=0;s_i<sockets;s_i++) {
@@ -1575,24 +2529,29 @@ public:
         printf("sparse mode\n");
       }
       #endif
-      int * recv_queue = new int [partitions];
-      int recv_queue_size = 0;
-      std::mutex recv_queue_mutex;
+      ReadyQueue recv_queue(partitions);
 
       current_send_part_id = partition_id;
-      #pragma omp parallel for
-      for (VertexId begin_v_i=partition_offset[partition_id];begin_v_i<partition_offset[partition_id+1];begin_v_i+=basic_chunk) {
-        VertexId v_i = begin_v_i;
-        unsigned long word = active->data[WORD_OFFSET(v_i)];
-        while (word != 0) {
-          if (word & 1) {
+      if (active->is_sparse()) {
+        #pragma omp parallel for
+        for (size_t l_i=0;l_i<active->list_size;l_i++) {
+          VertexId v_i = active->list[l_i];
+          if (v_i >= partition_offset[partition_id] && v_i < partition_offset[partition_id+1]) {
             local_send_buffer_loc[id] = local_send_buffer;
             send_buffer_loc[id] = send_buffer;
             part_id_val[id] = current_send_part_id;
             sparse_signal(v_i);
           }
-          v_i++;
-          word = word >> 1;
+        }
+      } else {
+        #pragma omp parallel for
+        for (VertexId begin_v_i=partition_offset[partition_id];begin_v_i<partition_offset[partition_id+1];begin_v_i+=VERTEX_CHUNK) {
+          active->for_each_bit(begin_v_i, std::min(begin_v_i + VERTEX_CHUNK, partition_offset[partition_id+1]), [&](VertexId v_i){
+            local_send_buffer_loc[id] = local_send_buffer;
+            send_buffer_loc[id] = send_buffer;
+            part_id_val[id] = current_send_part_id;
+            sparse_signal(v_i);
+          });
         }
       }
       #pragma omp parallel for
@@ -1603,43 +2562,57 @@ public:
         memcpy(send_buffer[current_send_part_id][s_i]->data + sizeof(MsgUnit<M>) * pos, local_send_buffer[t_i]->data, sizeof(MsgUnit<M>) * local_send_buffer[t_i]->count);
         local_send_buffer[t_i]->count = 0;
       }
-      recv_queue[recv_queue_size] = partition_id;
-      recv_queue_mutex.lock();
-      recv_queue_size += 1;
-      recv_queue_mutex.unlock();
-      std::thread send_thread([&](){
-        for (int step=1;step<partitions;step++) {
-          int i = (partition_id - step + partitions) % partitions;
-          for (int s_i=0;s_i<sockets;s_i++) {
-            MPI_Send(send_buffer[partition_id][s_i]->data, sizeof(MsgUnit<M>) * send_buffer[partition_id][s_i]->count, MPI_CHAR, i, PassMessage, MPI_COMM_WORLD);
+      bool nonblocking = (message_transport[id]==NonblockingTransport);
+      MessageRequests requests(partitions, sockets);
+      std::thread send_thread;
+      std::thread recv_thread;
+      if (nonblocking) {
+        post_message_recvs<M>(pool, requests, id);
+        for (int s_i=0;s_i<sockets && partitions>1;s_i++) {
+          size_t bytes;
+          char * data = pack_messages<M>(send_buffer[partition_id][s_i], pool->wire_send_buffer[partition_id][s_i], bytes, id);
+          for (int step=1;step<partitions;step++) {
+            int i = (partition_id - step + partitions) % partitions;
+            MPI_Isend(data, bytes, MPI_CHAR, i, PassMessage, MPI_COMM_WORLD, &requests.send[i * sockets + s_i]);
           }
         }
-      });
-      std::thread recv_thread([&](){
-        for (int step=1;step<partitions;step++) {
-          int i = (partition_id + step) % partitions;
-          for (int s_i=0;s_i<sockets;s_i++) {
-            MPI_Status recv_status;
-            MPI_Probe(i, PassMessage, MPI_COMM_WORLD, &recv_status);
-            MPI_Get_count(&recv_status, MPI_CHAR, &recv_buffer[i][s_i]->count);
-            MPI_Recv(recv_buffer[i][s_i]->data, recv_buffer[i][s_i]->count, MPI_CHAR, i, PassMessage, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            recv_buffer[i][s_i]->count /= sizeof(MsgUnit<M>);
+      } else {
+        recv_queue.push(partition_id);
+        send_thread = std::thread([&](){
+          // the same buffers go to every partition, so they are packed once
+          char ** packed_data = new char * [sockets];
+          size_t * packed_bytes = new size_t [sockets];
+          if (partitions > 1) {
+            for (int s_i=0;s_i<sockets;s_i++) {
+              packed_data[s_i] = pack_messages<M>(send_buffer[partition_id][s_i], pool->wire_send_buffer[partition_id][s_i], packed_bytes[s_i], id);
+            }
           }
-          recv_queue[recv_queue_size] = i;
-          recv_queue_mutex.lock();
-          recv_queue_size += 1;
-          recv_queue_mutex.unlock();
-        }
-      });
+          for (int step=1;step<partitions;step++) {
+            int i = (partition_id - step + partitions) % partitions;
+            for (int s_i=0;s_i<sockets;s_i++) {
+              MPI_Send(packed_data[s_i], packed_bytes[s_i], MPI_CHAR, i, PassMessage, MPI_COMM_WORLD);
+            }
+          }
+          delete [] packed_data;
+          delete [] packed_bytes;
+        });
+        recv_thread = std::thread([&](){
+          for (int step=1;step<partitions;step++) {
+            int i = (partition_id + step) % partitions;
+            for (int s_i=0;s_i<sockets;s_i++) {
+              recv_messages<M>(i, recv_buffer[i][s_i], pool->wire_recv_buffer[i][s_i], id);
+            }
+            recv_queue.push(i);
+          }
+        });
+      }
       for (int step=0;step<partitions;step++) {
-        while (true) {
-          recv_queue_mutex.lock();
-          bool condition = (recv_queue_size<=step);
-          recv_queue_mutex.unlock();
-          if (!condition) break;
-          __asm volatile ("pause" ::: "memory");
+        int i;
+        if (nonblocking) {
+          i = (step==0) ? partition_id : wait_message_recvs<M>(pool, requests, id);
+        } else {
+          i = recv_queue.pop();
         }
-        int i = recv_queue[step];
         MessageBuffer ** used_buffer;
         if (i==partition_id) {
           used_buffer = send_buffer[i];
@@ -1677,7 +2650,7 @@ public:
                 VertexId v_i = buffer[b_i].vertex;
                 M msg_data = buffer[b_i].msg_data;
                 if (outgoing_adj_bitmap[s_i]->get_bit(v_i)) {
-                  local_reducer += sparse_slot(v_i, msg_data, VertexAdjList<EdgeData>(outgoing_adj_list[s_i] + outgoing_adj_index[s_i][v_i], outgoing_adj_list[s_i] + outgoing_adj_index[s_i][v_i+1]));
+                  local_reducer += sparse_slot(v_i, msg_data, get_adj_list(outgoing_adj_list, outgoing_adj_stream, s_i, v_i, outgoing_adj_index[s_i][v_i], outgoing_adj_index[s_i][v_i+1]));
                 }
               }
             }
@@ -1698,7 +2671,7 @@ public:
                   VertexId v_i = buffer[b_i].vertex;
                   M msg_data = buffer[b_i].msg_data;
                   if (outgoing_adj_bitmap[s_i]->get_bit(v_i)) {
-                    local_reducer += sparse_slot(v_i, msg_data, VertexAdjList<EdgeData>(outgoing_adj_list[s_i] + outgoing_adj_index[s_i][v_i], outgoing_adj_list[s_i] + outgoing_adj_index[s_i][v_i+1]));
+                    local_reducer += sparse_slot(v_i, msg_data, get_adj_list(outgoing_adj_list, outgoing_adj_stream, s_i, v_i, outgoing_adj_index[s_i][v_i], outgoing_adj_index[s_i][v_i+1]));
                   }
                 }
               }
@@ -1707,9 +2680,12 @@ public:
           }
         }
       }
-      send_thread.join();
-      recv_thread.join();
-      delete [] recv_queue;
+      if (nonblocking) {
+        MPI_Waitall(partitions * sockets, requests.send, MPI_STATUSES_IGNORE);
+      } else {
+        send_thread.join();
+        recv_thread.join();
+      }
     } else {
       // dense selective bitmap
       if (dense_selective!=nullptr && partitions>1) {
@@ -1730,6 +2706,8 @@ public:
         send_thread.join();
         recv_thread.join();
         MPI_Barrier(MPI_COMM_WORLD);
+        // the received words bypassed set_bit, so the subset's list no longer covers them
+        dense_selective->mark_dense();
         sync_time += get_time();
         #ifdef PRINT_DEBUG_MESSAGES
         if (partition_id==0) {
@@ -1742,58 +2720,115 @@ public:
         printf("dense mode\n");
       }
       #endif
-      int * send_queue = new int [partitions];
-      int * recv_queue = new int [partitions];
-      volatile int send_queue_size = 0;
-      volatile int recv_queue_size = 0;
-      std::mutex send_queue_mutex;
-      std::mutex recv_queue_mutex;
-
-      std::thread send_thread([&](){
-        for (int step=0;step<partitions;step++) {
-          if (step==partitions-1) {
-            break;
+      ReadyQueue send_queue(partitions);
+      ReadyQueue recv_queue(partitions);
+
+      bool nonblocking = (message_transport[id]==NonblockingTransport);
+      MessageRequests requests(partitions, sockets);
+      std::thread send_thread;
+      std::thread recv_thread;
+      if (nonblocking) {
+        post_message_recvs<M>(pool, requests, id);
+      } else {
+        send_thread = std::thread([&](){
+          for (int step=0;step<partitions;step++) {
+            if (step==partitions-1) {
+              break;
+            }
+            int i = send_queue.pop();
+            for (int s_i=0;s_i<sockets;s_i++) {
+              size_t bytes;
+              char * data = pack_messages<M>(send_buffer[i][s_i], pool->wire_send_buffer[i][s_i], bytes, id);
+              MPI_Send(data, bytes, MPI_CHAR, i, PassMessage, MPI_COMM_WORLD);
+            }
           }
-          while (true) {
-            send_queue_mutex.lock();
-            bool condition = (send_queue_size<=step);
-            send_queue_mutex.unlock();
-            if (!condition) break;
-            __asm volatile ("pause" ::: "memory");
+        });
+        recv_thread = std::thread([&](){
+          std::vector<std::thread> threads;
+          for (int step=1;step<partitions;step++) {
+            int i = (partition_id - step + partitions) % partitions;
+            threads.emplace_back([&](int i){
+              for (int s_i=0;s_i<sockets;s_i++) {
+                recv_messages<M>(i, recv_buffer[i][s_i], pool->wire_recv_buffer[i][s_i], id);
+              }
+              recv_queue.push(i);
+            }, i);
           }
-          int i = send_queue[step];
-          for (int s_i=0;s_i<sockets;s_i++) {
-            MPI_Send(send_buffer[i][s_i]->data, sizeof(MsgUnit<M>) * send_buffer[i][s_i]->count, MPI_CHAR, i, PassMessage, MPI_COMM_WORLD);
+          for (int step=1;step<partitions;step++) {
+            threads[step-1].join();
           }
+          recv_queue.push(partition_id);
+        });
+      }
+      // apply the messages received from partition i
+      auto dense_apply = [&](int i) {
+        R partition_reducer = 0;
+        MessageBuffer ** used_buffer;
+        if (i==partition_id) {
+          used_buffer = send_buffer[i];
+        } else {
+          used_buffer = recv_buffer[i];
         }
-      });
-      std::thread recv_thread([&](){
-        std::vector<std::thread> threads;
-        for (int step=1;step<partitions;step++) {
-          int i = (partition_id - step + partitions) % partitions;
-          threads.emplace_back([&](int i){
-            for (int s_i=0;s_i<sockets;s_i++) {
-              MPI_Status recv_status;
-              MPI_Probe(i, PassMessage, MPI_COMM_WORLD, &recv_status);
-              MPI_Get_count(&recv_status, MPI_CHAR, &recv_buffer[i][s_i]->count);
-              MPI_Recv(recv_buffer[i][s_i]->data, recv_buffer[i][s_i]->count, MPI_CHAR, i, PassMessage, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-              recv_buffer[i][s_i]->count /= sizeof(MsgUnit<M>);
-            }
-          }, i);
+        for (int t_i=0;t_i<threads;t_i++) {
+          int s_i = get_socket_id(t_i);
+          int s_j = get_socket_offset(t_i);
+          VertexId partition_size = used_buffer[s_i]->count;
+          thread_state[t_i]->curr = partition_size / threads_per_socket  / basic_chunk * basic_chunk * s_j;
+          thread_state[t_i]->end = partition_size / threads_per_socket / basic_chunk * basic_chunk * (s_j+1);
+          if (s_j == threads_per_socket - 1) {
+            thread_state[t_i]->end = used_buffer[s_i]->count;
+          }
+          thread_state[t_i]->status = WORKING;
         }
-        for (int step=1;step<partitions;step++) {
-          int i = (partition_id - step + partitions) % partitions;
-          threads[step-1].join();
-          recv_queue[recv_queue_size] = i;
-          recv_queue_mutex.lock();
-          recv_queue_size += 1;
-          recv_queue_mutex.unlock();
+        #pragma omp parallel reduction(+:partition_reducer)
+        {
+          R local_reducer = 0;
+          int thread_id = omp_get_thread_num();
+          int s_i = get_socket_id(thread_id);
+          MsgUnit<M> * buffer = (MsgUnit<M> *)used_buffer[s_i]->data;
+          while (true) {
+            VertexId b_i = __sync_fetch_and_add(&thread_state[thread_id]->curr, basic_chunk);
+            if (b_i >= thread_state[thread_id]->end) break;
+            VertexId begin_b_i = b_i;
+            VertexId end_b_i = b_i + basic_chunk;
+            if (end_b_i>thread_state[thread_id]->end) {
+              end_b_i = thread_state[thread_id]->end;
+            }
+            for (b_i=begin_b_i;b_i<end_b_i;b_i++) {
+              VertexId v_i = buffer[b_i].vertex;
+              M msg_data = buffer[b_i].msg_data;
+              local_reducer += dense_slot(v_i, msg_data);
+            }
+          }
+          thread_state[thread_id]->status = STEALING;
+          // steal from threads on the same socket first, whose slices are in local memory
+          for (int pass=0;pass<2;pass++) {
+            for (int t_offset=1;t_offset<threads;t_offset++) {
+              int t_i = (thread_id + t_offset) % threads;
+              if ((get_socket_id(t_i)==s_i) != (pass==0)) continue;
+              if (thread_state[t_i]->status==STEALING) continue;
+              MsgUnit<M> * buffer = (MsgUnit<M> *)used_buffer[get_socket_id(t_i)]->data;
+              while (true) {
+                VertexId b_i = __sync_fetch_and_add(&thread_state[t_i]->curr, basic_chunk);
+                if (b_i >= thread_state[t_i]->end) break;
+                VertexId begin_b_i = b_i;
+                VertexId end_b_i = b_i + basic_chunk;
+                if (end_b_i>thread_state[t_i]->end) {
+                  end_b_i = thread_state[t_i]->end;
+                }
+                for (b_i=begin_b_i;b_i<end_b_i;b_i++) {
+                  VertexId v_i = buffer[b_i].vertex;
+                  M msg_data = buffer[b_i].msg_data;
+                  local_reducer += dense_slot(v_i, msg_data);
+                }
+              }
+            }
+          }
+          partition_reducer += local_reducer;
         }
-        recv_queue[recv_queue_size] = partition_id;
-        recv_queue_mutex.lock();
-        recv_queue_size += 1;
-        recv_queue_mutex.unlock();
-      });
+        reducer += partition_reducer;
+      };
+      int applied = 0;
       current_send_part_id = partition_id;
       for (int step=0;step<partitions;step++) {
         current_send_part_id = (current_send_part_id + 1) % partitions;
@@ -1818,7 +2853,7 @@ public:
               send_buffer_loc[id] = send_buffer;
               part_id_val[id] = current_send_part_id;
               VertexId v_i = compressed_incoming_adj_index[s_i][p_v_i].vertex;
-              dense_signal(v_i, VertexAdjList<EdgeData>(incoming_adj_list[s_i] + compressed_incoming_adj_index[s_i][p_v_i].index, incoming_adj_list[s_i] + compressed_incoming_adj_index[s_i][p_v_i+1].index));
+              dense_signal(v_i, get_adj_list(incoming_adj_list, incoming_adj_stream, s_i, v_i, compressed_incoming_adj_index[s_i][p_v_i].index, compressed_incoming_adj_index[s_i][p_v_i+1].index));
             }
           }
           thread_state[thread_id]->status = STEALING;
@@ -1836,7 +2871,7 @@ public:
                 local_send_buffer_loc[id] = local_send_buffer;
                 part_id_val[id] = current_send_part_id;
                 VertexId v_i = compressed_incoming_adj_index[s_i][p_v_i].vertex;
-                dense_signal(v_i, VertexAdjList<EdgeData>(incoming_adj_list[s_i] + compressed_incoming_adj_index[s_i][p_v_i].index, incoming_adj_list[s_i] + compressed_incoming_adj_index[s_i][p_v_i+1].index));
+                dense_signal(v_i, get_adj_list(incoming_adj_list, incoming_adj_stream, s_i, v_i, compressed_incoming_adj_index[s_i][p_v_i].index, compressed_incoming_adj_index[s_i][p_v_i+1].index));
               }
             }
           }
@@ -1849,81 +2884,73 @@ public:
           memcpy(send_buffer[current_send_part_id][s_i]->data + sizeof(MsgUnit<M>) * pos, local_send_buffer[t_i]->data, sizeof(MsgUnit<M>) * local_send_buffer[t_i]->count);
           local_send_buffer[t_i]->count = 0;
         }
-        if (i!=partition_id) {
-          send_queue[send_queue_size] = i;
-          send_queue_mutex.lock();
-          send_queue_size += 1;
-          send_queue_mutex.unlock();
-        }
-      }
-      for (int step=0;step<partitions;step++) {
-        while (true) {
-          recv_queue_mutex.lock();
-          bool condition = (recv_queue_size<=step);
-          recv_queue_mutex.unlock();
-          if (!condition) break;
-          __asm volatile ("pause" ::: "memory");
-        }
-        int i = recv_queue[step];
-        MessageBuffer ** used_buffer;
-        if (i==partition_id) {
-          used_buffer = send_buffer[i];
-        } else {
-          used_buffer = recv_buffer[i];
+        if (message_combiner[id]) {
+          combine_messages<M>(send_buffer[current_send_part_id], id);
         }
-        for (int t_i=0;t_i<threads;t_i++) {
-          int s_i = get_socket_id(t_i);
-          int s_j = get_socket_offset(t_i);
-          VertexId partition_size = used_buffer[s_i]->count;
-          thread_state[t_i]->curr = partition_size / threads_per_socket  / basic_chunk * basic_chunk * s_j;
-          thread_state[t_i]->end = partition_size / threads_per_socket / basic_chunk * basic_chunk * (s_j+1);
-          if (s_j == threads_per_socket - 1) {
-            thread_state[t_i]->end = used_buffer[s_i]->count;
+        if (i!=partition_id && nonblocking) {
+          for (int s_i=0;s_i<sockets;s_i++) {
+            size_t bytes;
+            char * data = pack_messages<M>(send_buffer[i][s_i], pool->wire_send_buffer[i][s_i], bytes, id);
+            MPI_Isend(data, bytes, MPI_CHAR, i, PassMessage, MPI_COMM_WORLD, &requests.send[i * sockets + s_i]);
           }
-          thread_state[t_i]->status = WORKING;
+        } else if (i!=partition_id) {
+          send_queue.push(i);
         }
-        #pragma omp parallel reduction(+:reducer)
-        {
-          R local_reducer = 0;
-          int thread_id = omp_get_thread_num();
-          int s_i = get_socket_id(thread_id);
-          MsgUnit<M> * buffer = (MsgUnit<M> *)used_buffer[s_i]->data;
-          while (true) {
-            VertexId b_i = __sync_fetch_and_add(&thread_state[thread_id]->curr, basic_chunk);
-            if (b_i >= thread_state[thread_id]->end) break;
-            VertexId begin_b_i = b_i;
-            VertexId end_b_i = b_i + basic_chunk;
-            if (end_b_i>thread_state[thread_id]->end) {
-              end_b_i = thread_state[thread_id]->end;
-            }
-            for (b_i=begin_b_i;b_i<end_b_i;b_i++) {
-              VertexId v_i = buffer[b_i].vertex;
-              M msg_data = buffer[b_i].msg_data;
-              local_reducer += dense_slot(v_i, msg_data);
-            }
+        if (dense_overlap[id]) {
+          // the local partition is always the last one ready, so only other partitions are drained here
+          while (applied < partitions - 1) {
+            int r_i = nonblocking ? wait_message_recvs<M>(pool, requests, id, false) : recv_queue.try_pop();
+            if (r_i < 0) break;
+            dense_apply(r_i);
+            applied += 1;
           }
-          thread_state[thread_id]->status = STEALING;
-          reducer += local_reducer;
         }
       }
-      send_thread.join();
-      recv_thread.join();
-      delete [] send_queue;
-      delete [] recv_queue;
+      while (applied < partitions) {
+        int i;
+        if (nonblocking) {
+          i = (applied==partitions-1) ? partition_id : wait_message_recvs<M>(pool, requests, id);
+        } else {
+          i = recv_queue.pop();
+        }
+        dense_apply(i);
+        applied += 1;
+      }
+      if (nonblocking) {
+        MPI_Waitall(partitions * sockets, requests.send, MPI_STATUSES_IGNORE);
+      } else {
+        send_thread.join();
+        recv_thread.join();
+      }
     }
 
     R global_reducer;
     MPI_Datatype dt = get_mpi_data_type<R>();
     MPI_Allreduce(&reducer, &global_reducer, 1, dt, MPI_SUM, MPI_COMM_WORLD);
     stream_time += MPI_Wtime();
+    stats.time = stream_time;
+    if (direction_history[id].size()==DIRECTION_HISTORY) {
+      direction_history[id].erase(direction_history[id].begin());
+    }
+    direction_history[id].push_back(stats);
     #ifdef PRINT_DEBUG_MESSAGES
     if (partition_id==0) {
       printf("process_edges took %lf (s)\n", stream_time);
+      if (message_compression[id]) {
+        CodecStats stats = get_codec_stats(id);
+        printf("message codec: %lu -> %lu bytes (%.2lfx), encode %lf (s), decode %lf (s)\n", stats.raw_bytes, stats.wire_bytes, (double)stats.raw_bytes / stats.wire_bytes, stats.encode_time, stats.decode_time);
+      }
     }
     #endif
     return global_reducer;
   }
 
+  // type-erased form for callers that keep their callbacks in std::function
+  template<typename R, typename M>
+  R process_edges(std::function<void(VertexId)> sparse_signal, std::function<R(VertexId, M, VertexAdjList<EdgeData>)> sparse_slot, std::function<void(VertexId, VertexAdjList<EdgeData>)> dense_signal, std::function<R(VertexId, M)> dense_slot, VertexSubset * active, VertexSubset * dense_selective = nullptr, int id = 0) {
+    return process_edges<R, M, std::function<void(VertexId)> &, std::function<R(VertexId, M, VertexAdjList<EdgeData>)> &, std::function<void(VertexId, VertexAdjList<EdgeData>)> &, std::function<R(VertexId, M)> &>(sparse_signal, sparse_slot, dense_signal, dense_slot, active, dense_selective, id);
+  }
+
 };
 
 #endif
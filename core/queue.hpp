@@ -0,0 +1,90 @@
+/*
+Copyright (c) 2015-2016 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef QUEUE_HPP
+#define QUEUE_HPP
+
+#include <unistd.h>
+#include <limits.h>
+#include <assert.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "core/constants.hpp"
+
+inline void futex_wait(int * addr, int val) {
+  syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+inline void futex_wake(int * addr) {
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+// bounded lock-free queue of non-negative ids (e.g. partitions whose buffers are ready)
+// any number of producers push, a single consumer pops in push order;
+// pop spins for READY_QUEUE_SPINS rounds and then sleeps on a futex until the next id is published
+class ReadyQueue {
+  int * slots; // -1 while empty
+  int capacity;
+  int tail; // next slot claimed by a producer
+  int head; // next slot popped by the consumer
+  int sleeping;
+public:
+  ReadyQueue(int capacity) : capacity(capacity), tail(0), head(0), sleeping(0) {
+    slots = new int [capacity];
+    for (int i=0;i<capacity;i++) {
+      slots[i] = -1;
+    }
+  }
+  ~ReadyQueue() {
+    delete [] slots;
+  }
+  // each queue holds at most capacity ids over its lifetime
+  void push(int item) {
+    assert(item >= 0);
+    int pos = __atomic_fetch_add(&tail, 1, __ATOMIC_RELAXED);
+    assert(pos < capacity);
+    __atomic_store_n(&slots[pos], item, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sleeping, __ATOMIC_SEQ_CST)) {
+      futex_wake(&slots[pos]);
+    }
+  }
+  // the next id if it has already been published, otherwise -1
+  int try_pop() {
+    if (head==capacity) return -1;
+    int item = __atomic_load_n(&slots[head], __ATOMIC_ACQUIRE);
+    if (item >= 0) head += 1;
+    return item;
+  }
+  int pop() {
+    assert(head < capacity);
+    int * slot = &slots[head++];
+    int item;
+    for (int spin=0;spin<READY_QUEUE_SPINS;spin++) {
+      item = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+      if (item >= 0) return item;
+      __asm volatile ("pause" ::: "memory");
+    }
+    __atomic_store_n(&sleeping, 1, __ATOMIC_SEQ_CST);
+    while ((item = __atomic_load_n(slot, __ATOMIC_SEQ_CST)) < 0) {
+      futex_wait(slot, -1);
+    }
+    __atomic_store_n(&sleeping, 0, __ATOMIC_RELAXED);
+    return item;
+  }
+};
+
+#endif
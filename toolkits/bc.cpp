@@ -413,8 +413,9 @@ int main(int argc, char ** argv) {
 
   Graph<Empty> * graph;
   graph = new Graph<Empty>();
-  VertexId root = std::atoi(argv[3]);
   graph->load_directed(argv[1], std::atoi(argv[2]));
+  // roots are given as ids of the input file, which differ from internal ids under vertex_order
+  VertexId root = graph->get_internal_vertex_id(std::atoi(argv[3]));
 
   #if COMPACT
   compute_compact(graph, root);
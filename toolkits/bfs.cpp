@@ -32,6 +32,7 @@ void compute(Graph<Empty> * graph, VertexId root) {
   visited->set_bit(root);
   active_in->clear();
   active_in->set_bit(root);
+  active_out->clear();
   graph->fill_vertex_array(parent, graph->vertices);
   parent[root] = root;
 
@@ -41,7 +42,6 @@ void compute(Graph<Empty> * graph, VertexId root) {
     if (graph->partition_id==0) {
       printf("active(%d)>=%u\n", i_i, active_vertices);
     }
-    active_out->clear();
     active_vertices = graph->process_edges<VertexId,VertexId>(
       [&](VertexId src){
         graph->emit(src, src);
@@ -50,7 +50,7 @@ void compute(Graph<Empty> * graph, VertexId root) {
         VertexId activated = 0;
         for (AdjUnit<Empty> * ptr=outgoing_adj.begin;ptr!=outgoing_adj.end;ptr++) {
           VertexId dst = ptr->neighbour;
-          if (parent[dst]==graph->vertices && cas(&parent[dst], graph->vertices, src)) {
+          if (ttas(&parent[dst], graph->vertices, src)) {
             active_out->set_bit(dst);
             activated += 1;
           }
@@ -68,7 +68,7 @@ void compute(Graph<Empty> * graph, VertexId root) {
         }
       },
       [&](VertexId dst, VertexId msg) {
-        if (cas(&parent[dst], graph->vertices, msg)) {
+        if (ttas(&parent[dst], graph->vertices, msg)) {
           active_out->set_bit(dst);
           return 1;
         }
@@ -76,14 +76,11 @@ void compute(Graph<Empty> * graph, VertexId root) {
       },
       active_in, visited
     );
-    active_vertices = graph->process_vertices<VertexId>(
-      [&](VertexId vtx) {
-        visited->set_bit(vtx);
-        return 1;
-      },
-      active_out
-    );
-    std::swap(active_in, active_out);
+    VertexId owned_begin = graph->partition_offset[graph->partition_id];
+    VertexId owned_end = graph->partition_offset[graph->partition_id+1];
+    visited->or_with(active_out, owned_begin, owned_end);
+    active_vertices = graph->count_vertices(active_out);
+    active_in->swap_and_clear(active_out, owned_begin, owned_end);
   }
 
   exec_time += get_time();
@@ -118,8 +115,9 @@ int main(int argc, char ** argv) {
 
   Graph<Empty> * graph;
   graph = new Graph<Empty>();
-  VertexId root = std::atoi(argv[3]);
   graph->load_directed(argv[1], std::atoi(argv[2]));
+  // roots are given as ids of the input file, which differ from internal ids under vertex_order
+  VertexId root = graph->get_internal_vertex_id(std::atoi(argv[3]));
 
   compute(graph, root);
   // for (int run=0;run<5;run++) {
@@ -50,7 +50,7 @@ void compute(Graph<Empty> * graph) {
         for (AdjUnit<Empty> * ptr=outgoing_adj.begin;ptr!=outgoing_adj.end;ptr++) {
           VertexId dst = ptr->neighbour;
           if (msg < label[dst]) {
-            write_min(&label[dst], msg);
+            write_min_relaxed(&label[dst], msg);
             active_out->set_bit(dst);
             activated += 1;
           }
@@ -71,7 +71,7 @@ void compute(Graph<Empty> * graph) {
       },
       [&](VertexId dst, VertexId msg) {
         if (msg < label[dst]) {
-          write_min(&label[dst], msg);
+          write_min_relaxed(&label[dst], msg);
           active_out->set_bit(dst);
           return 1u;
         }
@@ -44,11 +44,20 @@ void compute(Graph<Empty> * graph, int iterations) {
   );
   delta /= graph->vertices;
 
+  // contributions to the same vertex add up, so merge them before they are sent
+  graph->set_message_combiner<double>([](double a, double b){
+    return a + b;
+  });
+  // dense_slot only writes next, which dense_signal never reads
+  graph->set_dense_overlap(true);
+  // hub vertices take many adds per superstep; only same-socket threads contend on each slot
+  AddReduction<double> * next_sum = graph->alloc_add_reduction(next, SocketLocalReduction);
   for (int i_i=0;i_i<iterations;i_i++) {
     if (graph->partition_id==0) {
       printf("delta(%d)=%lf\n", i_i, delta);
     }
     graph->fill_vertex_array(next, (double)0);
+    next_sum->array = next;
     graph->process_edges<int,double>(
       [&](VertexId src){
         graph->emit(src, curr[src]);
@@ -56,7 +65,7 @@ void compute(Graph<Empty> * graph, int iterations) {
       [&](VertexId src, double msg, VertexAdjList<Empty> outgoing_adj){
         for (AdjUnit<Empty> * ptr=outgoing_adj.begin;ptr!=outgoing_adj.end;ptr++) {
           VertexId dst = ptr->neighbour;
-          write_add(&next[dst], msg);
+          graph->reduce_add(next_sum, dst, msg);
         }
         return 0;
       },
@@ -69,11 +78,12 @@ void compute(Graph<Empty> * graph, int iterations) {
         graph->emit(dst, sum);
       },
       [&](VertexId dst, double msg) {
-        write_add(&next[dst], msg);
+        graph->reduce_add(next_sum, dst, msg);
         return 0;
       },
       active
     );
+    graph->merge_add_reduction(next_sum);
     if (i_i==iterations-1) {
       delta = graph->process_vertices<double>(
         [&](VertexId vtx) {
@@ -125,6 +135,7 @@ void compute(Graph<Empty> * graph, int iterations) {
 
   graph->dealloc_vertex_array(curr);
   graph->dealloc_vertex_array(next);
+  graph->dealloc_add_reduction(next_sum);
   delete active;
 }
 
@@ -16,11 +16,27 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include "core/graph.hpp"
 
 typedef float Weight;
 
+// report the farthest reachable vertex
+void print_farthest(Graph<Weight> * graph, Weight * distance, VertexId root) {
+  graph->gather_vertex_array(distance, 0);
+  if (graph->partition_id==0) {
+    // the gathered array is indexed by original ids, root is an internal one
+    VertexId max_v_i = graph->get_original_vertex_id(root);
+    for (VertexId v_i=0;v_i<graph->vertices;v_i++) {
+      if (distance[v_i] < 1e9 && distance[v_i] > distance[max_v_i]) {
+        max_v_i = v_i;
+      }
+    }
+    printf("distance[%u]=%f\n", max_v_i, distance[max_v_i]);
+  }
+}
+
 void compute(Graph<Weight> * graph, VertexId root) {
   double exec_time = 0;
   exec_time -= get_time();
@@ -49,7 +65,7 @@ void compute(Graph<Weight> * graph, VertexId root) {
           VertexId dst = ptr->neighbour;
           Weight relax_dist = msg + ptr->edge_data;
           if (relax_dist < distance[dst]) {
-            if (write_min(&distance[dst], relax_dist)) {
+            if (write_min_relaxed(&distance[dst], relax_dist)) {
               active_out->set_bit(dst);
               activated += 1;
             }
@@ -72,7 +88,7 @@ void compute(Graph<Weight> * graph, VertexId root) {
       },
       [&](VertexId dst, Weight msg) {
         if (msg < distance[dst]) {
-          write_min(&distance[dst], msg);
+          write_min_relaxed(&distance[dst], msg);
           active_out->set_bit(dst);
           return 1;
         }
@@ -88,36 +104,190 @@ void compute(Graph<Weight> * graph, VertexId root) {
     printf("exec_time=%lf(s)\n", exec_time);
   }
 
-  graph->gather_vertex_array(distance, 0);
-  if (graph->partition_id==0) {
-    VertexId max_v_i = root;
-    for (VertexId v_i=0;v_i<graph->vertices;v_i++) {
-      if (distance[v_i] < 1e9 && distance[v_i] > distance[max_v_i]) {
-        max_v_i = v_i;
+  print_farthest(graph, distance, root);
+
+  graph->dealloc_vertex_array(distance);
+  delete active_in;
+  delete active_out;
+}
+
+// delta-stepping: vertices are settled bucket by bucket (bucket b holds distances in [b*delta, (b+1)*delta));
+// light edges (weight <= delta) are relaxed repeatedly until the current bucket stops changing,
+// heavy edges only once per bucket, and empty buckets are skipped in one step
+void compute_delta_stepping(Graph<Weight> * graph, VertexId root, Weight delta) {
+  double exec_time = 0;
+  exec_time -= get_time();
+
+  Weight * distance = graph->alloc_vertex_array<Weight>();
+  Weight * relaxed = graph->alloc_vertex_array<Weight>(); // distance at which the edges were last relaxed
+  VertexSubset * pending = graph->alloc_vertex_subset(); // improved, but not yet relaxed
+  VertexSubset * next_pending = graph->alloc_vertex_subset();
+  VertexSubset * frontier = graph->alloc_vertex_subset();
+  VertexSubset * next_frontier = graph->alloc_vertex_subset();
+  VertexSubset * bucket = graph->alloc_vertex_subset();
+  pending->clear();
+  pending->set_bit(root);
+  graph->fill_vertex_array(distance, (Weight)1e9);
+  graph->fill_vertex_array(relaxed, (Weight)1e9);
+  distance[root] = (Weight)0;
+  // buckets are compared by index rather than by a computed upper bound, which can round down to
+  // the minimum distance itself when delta is not exactly representable and leave the bucket empty
+  auto bucket_of = [&](Weight dist) {
+    return (long)std::floor(dist / delta);
+  };
+  long current_bucket = 0;
+
+  // relax the edges of the active vertices whose weight class matches light;
+  // light improvements within current_bucket rejoin it, the others wait in pending. The heavy pass runs
+  // after the bucket is settled, so its improvements always go to pending, even those that round into
+  // current_bucket; they are picked up again when the next bucket is chosen
+  auto relax = [&](VertexSubset * active, bool light) {
+    auto in_class = [&](Weight weight) {
+      return (weight <= delta) == light;
+    };
+    auto improve = [&](VertexId dst, Weight dist) {
+      if (light && bucket_of(dist) <= current_bucket) {
+        next_frontier->set_bit(dst);
+        return 1;
       }
+      pending->set_bit(dst);
+      return 0;
+    };
+    return graph->process_edges<VertexId,Weight>(
+      [&](VertexId src){
+        graph->emit(src, distance[src]);
+      },
+      [&](VertexId src, Weight msg, VertexAdjList<Weight> outgoing_adj){
+        VertexId activated = 0;
+        for (AdjUnit<Weight> * ptr=outgoing_adj.begin;ptr!=outgoing_adj.end;ptr++) {
+          if (!in_class(ptr->edge_data)) continue;
+          VertexId dst = ptr->neighbour;
+          Weight relax_dist = msg + ptr->edge_data;
+          if (relax_dist < distance[dst]) {
+            if (write_min_relaxed(&distance[dst], relax_dist)) {
+              activated += improve(dst, relax_dist);
+            }
+          }
+        }
+        return activated;
+      },
+      [&](VertexId dst, VertexAdjList<Weight> incoming_adj) {
+        Weight msg = 1e9;
+        for (AdjUnit<Weight> * ptr=incoming_adj.begin;ptr!=incoming_adj.end;ptr++) {
+          VertexId src = ptr->neighbour;
+          if (in_class(ptr->edge_data) && active->get_bit(src)) {
+            Weight relax_dist = distance[src] + ptr->edge_data;
+            if (relax_dist < msg) {
+              msg = relax_dist;
+            }
+          }
+        }
+        if (msg < 1e9) graph->emit(dst, msg);
+      },
+      [&](VertexId dst, Weight msg) {
+        if (msg < distance[dst]) {
+          if (write_min_relaxed(&distance[dst], msg)) {
+            return improve(dst, msg);
+          }
+        }
+        return 0;
+      },
+      active
+    );
+  };
+
+  for (int b_i=0;;b_i++) {
+    // the lowest bucket holding a pending vertex; vertices relaxed at their current distance are dropped
+    Weight min_distance = 1e9;
+    VertexId pending_vertices = graph->process_vertices<VertexId>(
+      [&](VertexId vtx) {
+        if (distance[vtx] >= relaxed[vtx]) return 0;
+        write_min(&min_distance, distance[vtx]);
+        return 1;
+      },
+      pending
+    );
+    if (pending_vertices==0) break;
+    MPI_Allreduce(MPI_IN_PLACE, &min_distance, 1, get_mpi_data_type<Weight>(), MPI_MIN, MPI_COMM_WORLD);
+    current_bucket = bucket_of(min_distance);
+    frontier->clear();
+    next_pending->clear();
+    VertexId active_vertices = graph->process_vertices<VertexId>(
+      [&](VertexId vtx) {
+        if (distance[vtx] >= relaxed[vtx]) return 0;
+        if (bucket_of(distance[vtx]) <= current_bucket) {
+          frontier->set_bit(vtx);
+          return 1;
+        }
+        next_pending->set_bit(vtx);
+        return 0;
+      },
+      pending
+    );
+    std::swap(pending, next_pending);
+    if (graph->partition_id==0) {
+      printf("bucket(%d)=%ld pending=%u\n", b_i, current_bucket, pending_vertices);
     }
-    printf("distance[%u]=%f\n", max_v_i, distance[max_v_i]);
+    bucket->clear();
+    while (active_vertices > 0) {
+      graph->process_vertices<VertexId>(
+        [&](VertexId vtx) {
+          relaxed[vtx] = distance[vtx];
+          bucket->set_bit(vtx);
+          return 0;
+        },
+        frontier
+      );
+      next_frontier->clear();
+      active_vertices = relax(frontier, true);
+      std::swap(frontier, next_frontier);
+    }
+    relax(bucket, false);
   }
 
+  exec_time += get_time();
+  if (graph->partition_id==0) {
+    printf("exec_time=%lf(s)\n", exec_time);
+  }
+
+  print_farthest(graph, distance, root);
+
   graph->dealloc_vertex_array(distance);
-  delete active_in;
-  delete active_out;
+  graph->dealloc_vertex_array(relaxed);
+  delete pending;
+  delete next_pending;
+  delete frontier;
+  delete next_frontier;
+  delete bucket;
 }
 
 int main(int argc, char ** argv) {
   MPI_Instance mpi(&argc, &argv);
 
   if (argc<4) {
-    printf("sssp [file] [vertices] [root]\n");
+    printf("sssp [file] [vertices] [root] [delta (optional, enables delta-stepping)]\n");
     exit(-1);
   }
 
   Graph<Weight> * graph;
   graph = new Graph<Weight>();
   graph->load_directed(argv[1], std::atoi(argv[2]));
-  VertexId root = std::atoi(argv[3]);
+  // roots are given as ids of the input file, which differ from internal ids under vertex_order
+  VertexId root = graph->get_internal_vertex_id(std::atoi(argv[3]));
 
-  compute(graph, root);
+  if (argc>4) {
+    Weight delta = std::atof(argv[4]);
+    if (!(delta > 0)) {
+      if (graph->partition_id==0) {
+        printf("delta must be positive\n");
+      }
+      delete graph;
+      exit(-1);
+    }
+    compute_delta_stepping(graph, root, delta);
+  } else {
+    compute(graph, root);
+  }
   // for (int run=0;run<5;run++) {
   //   compute(graph, root);
   // }